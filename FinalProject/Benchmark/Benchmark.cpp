@@ -0,0 +1,466 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../FinalProject/Instrumentation.h"
+#include "../FinalProject/Parallel.h"
+#include "../FinalProject/Reconstructor.h"
+#include "../FinalProject/Tiling.h"
+
+#include "BenchmarkCommon.h"
+
+
+/*
+*	PIPELINE BENCHMARK
+*
+*		runs every stage of the reconstruction on the
+*		bundled clouds, repeatedly and for several
+*		thread counts, and reports the median and p95
+*		wall time of every stage with its throughput
+*
+*		the medians can be saved as a baseline, and a
+*		later run compared against it: a stage slower
+*		than baseline * (1 + tolerance) is a regression
+*		and makes the benchmark exit with 2
+*
+*		--check-orientation instead checks that the
+*		out-of-core normals have the signs of the
+*		in-core ones, also exiting with 2 when not
+*
+*/
+
+
+namespace constants
+{
+	const size_t radiusNeighbors = 24;			// neighbors per radius query, ~ kRadius = 0.3 on face_reduced
+	const double regressionFloor = 1e-3; // seconds, slowdowns below this are noise
+}
+
+
+struct Options
+{
+	std::string dataPath;
+	std::vector<std::string> datasets;
+	std::vector<unsigned int> threads;
+	unsigned int repetitions;
+	unsigned int warmup;
+	std::string baselineFilename;
+	std::string saveBaselineFilename;
+	double tolerance;
+	double minAgreement;				// share of out-of-core signs that must match in-core, 0 to time the stages
+
+	Options()
+		: dataPath("PointClouds/"), repetitions(5), warmup(1), tolerance(0.10), minAgreement(0)
+	{
+		const char *clouds[] = { "face_reduced", "face", "red_pepper", "pills", "tigerfighter" };
+		datasets.assign(clouds, clouds + 5);
+		threads.push_back(1);
+	}
+};
+
+
+void printUsage(const char *program)
+{
+	std::cout << "usage: " << program << " [options]\n"
+		<< "  --data DIR            folder with the clouds (PointClouds/)\n"
+		<< "  --datasets a,b,...    cloud names without extension (all bundled clouds)\n"
+		<< "  --threads 1,2,...     worker thread counts to run (1)\n"
+		<< "  --repetitions N       timed runs per configuration (5)\n"
+		<< "  --warmup N            untimed runs per configuration (1)\n"
+		<< "  --baseline FILE       compare the medians against FILE\n"
+		<< "  --save-baseline FILE  write the medians to FILE\n"
+		<< "  --tolerance T         allowed slowdown over the baseline (0.10)\n"
+		<< "  --check-orientation S instead of timing, check that at least a share S of the\n"
+		<< "                        out-of-core normals have the sign of the in-core ones\n"
+		<< "\nexits with 2 if a stage is slower than its baseline or a check fails\n";
+}
+
+
+bool parseOptions(int argc, char **argv, Options& options)
+{
+	for (int a = 1; a < argc; a++)
+	{
+		std::string arg = argv[a];
+		if (arg == "--help" || arg == "-h")
+			return false;
+
+		if (a + 1 >= argc)
+		{
+			std::cerr << "ERROR: missing value for " << arg << std::endl;
+			return false;
+		}
+		std::string value = argv[++a];
+
+		if (arg == "--data")
+			options.dataPath = value;
+		else if (arg == "--datasets")
+			options.datasets = splitList(value);
+		else if (arg == "--threads")
+		{
+			options.threads.clear();
+			std::vector<std::string> counts = splitList(value);
+			for (size_t t = 0; t < counts.size(); t++)
+				options.threads.push_back((unsigned int)std::atoi(counts[t].c_str()));
+		}
+		else if (arg == "--repetitions")
+			options.repetitions = std::max(1, std::atoi(value.c_str()));
+		else if (arg == "--warmup")
+			options.warmup = std::max(0, std::atoi(value.c_str()));
+		else if (arg == "--baseline")
+			options.baselineFilename = value;
+		else if (arg == "--save-baseline")
+			options.saveBaselineFilename = value;
+		else if (arg == "--tolerance")
+			options.tolerance = std::atof(value.c_str());
+		else if (arg == "--check-orientation")
+			options.minAgreement = std::atof(value.c_str());
+		else
+		{
+			std::cerr << "ERROR: unknown option " << arg << std::endl;
+			return false;
+		}
+	}
+
+	if (!options.dataPath.empty() && options.dataPath.back() != '/' && options.dataPath.back() != '\\')
+		options.dataPath += '/';
+
+	return true;
+}
+
+
+/*
+	runPipeline
+
+		one reconstruction with the default
+		parameters, so the radius is derived from the
+		density of the cloud, and nothing written to
+		disk. Returns false if the cloud can't be
+		loaded.
+*/
+
+bool runPipeline(const std::string& filename, unsigned int nThreads, StageProfiler& profiler, size_t& nPoints)
+{
+	ReconstructionParameters parameters;
+	parameters.radiusNeighbors = constants::radiusNeighbors;
+	parameters.nThreads = nThreads;
+
+	Reconstructor reconstructor(parameters);
+	reconstructor.attachProfiler(&profiler);
+
+	nPoints = 0;
+	if (!reconstructor.loadCloud(filename))
+		return false;
+
+	nPoints = reconstructor.nPoints();
+	reconstructor.reconstruct();
+	profiler.end();
+
+	return true;
+}
+
+
+/*
+	orientationAgreement
+
+		Orients the cloud in core, then out of core
+		under the same radius, and returns the share
+		of the points whose normals have the same
+		sign in both, -1 if a run fails. The
+		oriented PLY stores single precision, the
+		points are matched at that precision.
+*/
+
+double orientationAgreement(const std::string& filename, const std::string& workPrefix, unsigned int nThreads)
+{
+	ReconstructionParameters parameters;
+	parameters.radiusNeighbors = constants::radiusNeighbors;
+	parameters.nThreads = nThreads;
+
+	Reconstructor reconstructor(parameters);
+	if (!reconstructor.loadCloud(filename))
+		return -1;
+
+	reconstructor.orientNormals();
+
+	Vec3Arrays inCore;
+	reconstructor.inputNormals(inCore);
+
+	TilingParameters tiling;
+	tiling.radius = reconstructor.radius();
+	tiling.nThreads = nThreads;
+	tiling.workPrefix = workPrefix;
+
+	std::string output = workPrefix + "_oriented.ply";
+	TilingReport report;
+	alglib::real_2d_array points, normals;
+	size_t nPoints = 0;
+	bool oriented = orientOutOfCore(filename, FORMAT_UNKNOWN, output, FORMAT_PLY, tiling, report)
+		&& loadPly(output, points, nPoints, &normals);
+	std::remove(output.c_str());
+	if (!oriented)
+		return -1;
+
+	typedef std::array<float, 3> Key;
+	std::map<Key, size_t> inputIndex;
+	const alglib::real_2d_array& input = reconstructor.inputPoints();
+	for (size_t i = 0; i < reconstructor.nInputPoints(); i++)
+	{
+		Key key = { { float(input[i][0]), float(input[i][1]), float(input[i][2]) } };
+		inputIndex[key] = i;
+	}
+
+	size_t agree = 0;
+	for (size_t i = 0; i < nPoints; i++)
+	{
+		Key key = { { float(points[i][0]), float(points[i][1]), float(points[i][2]) } };
+		std::map<Key, size_t>::const_iterator found = inputIndex.find(key);
+		if (found == inputIndex.end())
+			continue;
+
+		double dot = 0;
+		for (size_t d = 0; d < 3; d++)
+			dot += normals[i][d] * inCore(found->second, d);
+		if (dot > 0)
+			agree++;
+	}
+
+	return nPoints > 0 ? double(agree) / double(nPoints) : 1.0;
+}
+
+
+struct StageResult
+{
+	std::string dataset;
+	unsigned int threads;
+	std::string stage;
+	size_t points;
+	double median;
+	double p95;
+};
+
+
+std::string resultKey(const std::string& dataset, unsigned int threads, const std::string& stage)
+{
+	std::ostringstream key;
+	key << dataset << ' ' << threads << ' ' << stage;
+	return key.str();
+}
+
+
+/*
+	baseline files
+
+		one line per dataset, thread count and
+		stage with the median seconds:
+
+			dataset threads stage median
+
+		stage names with spaces are written with
+		underscores
+*/
+
+std::string baselineStage(std::string stage)
+{
+	std::replace(stage.begin(), stage.end(), ' ', '_');
+	return stage;
+}
+
+
+bool saveBaseline(const std::string& filename, const std::vector<StageResult>& results)
+{
+	std::ofstream out(filename);
+	out << "# dataset threads stage median_seconds" << std::endl;
+	out << std::setprecision(9);
+	for (size_t r = 0; r < results.size(); r++)
+		out << results[r].dataset << ' ' << results[r].threads << ' ' << baselineStage(results[r].stage) << ' ' << results[r].median << std::endl;
+	return bool(out);
+}
+
+
+bool loadBaseline(const std::string& filename, std::map<std::string, double>& baseline)
+{
+	std::ifstream in(filename);
+	if (!in)
+		return false;
+
+	std::string line;
+	while (std::getline(in, line))
+	{
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		std::istringstream fields(line);
+		std::string dataset, stage;
+		unsigned int threads;
+		double median;
+		if (fields >> dataset >> threads >> stage >> median)
+			baseline[resultKey(dataset, threads, stage)] = median;
+	}
+	return true;
+}
+
+
+int main(int argc, char **argv)
+{
+	Options options;
+	if (!parseOptions(argc, argv, options))
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	if (options.minAgreement > 0)
+	{
+		int status = 0;
+		for (size_t d = 0; d < options.datasets.size(); d++)
+		{
+			const std::string& dataset = options.datasets[d];
+			unsigned int nThreads = options.threads[0];
+			setAlglibWorkers(nThreads);
+
+			double agreement = orientationAgreement(options.dataPath + dataset + ".obj", "benchmark_" + dataset, nThreads);
+			if (agreement < 0)
+			{
+				std::cerr << "ERROR: " << dataset << " could not be oriented!" << std::endl;
+				return 1;
+			}
+
+			bool passed = agreement >= options.minAgreement;
+			std::cout << (passed ? "OK " : "MISMATCH ") << dataset << ": " << agreement * 100 << "% of the out-of-core normals have the in-core sign" << std::endl;
+			if (!passed)
+				status = 2;
+		}
+		return status;
+	}
+
+	std::vector<StageResult> results;
+
+	for (size_t d = 0; d < options.datasets.size(); d++)
+	{
+		const std::string& dataset = options.datasets[d];
+		std::string filename = options.dataPath + dataset + ".obj";
+
+		for (size_t t = 0; t < options.threads.size(); t++)
+		{
+			unsigned int nThreads = options.threads[t];
+			setAlglibWorkers(nThreads);
+
+			// stage name -> wall seconds of every timed run, in pipeline order
+			std::vector<std::string> stageOrder;
+			std::map<std::string, std::vector<double> > samples;
+			size_t nPoints = 0;
+			bool ran = true;
+
+			for (unsigned int run = 0; run < options.warmup + options.repetitions && ran; run++)
+			{
+				StageProfiler profiler;
+				ran = runPipeline(filename, nThreads, profiler, nPoints);
+				if (!ran || run < options.warmup)
+					continue;
+
+				for (size_t s = 0; s < profiler.stages().size(); s++)
+				{
+					const StageRecord& record = profiler.stages()[s];
+					if (samples.find(record.name) == samples.end())
+						stageOrder.push_back(record.name);
+					samples[record.name].push_back(record.wallSeconds);
+				}
+			}
+
+			if (!ran)
+			{
+				std::cerr << "Skipping " << dataset << ": " << filename << " could not be loaded" << std::endl;
+				break;
+			}
+
+			// per run total, the sum of the stages
+			std::vector<double> totals(options.repetitions, 0.0);
+			for (size_t s = 0; s < stageOrder.size(); s++)
+			{
+				const std::vector<double>& stageSamples = samples[stageOrder[s]];
+				StageResult result = { dataset, nThreads, stageOrder[s], nPoints, percentile(stageSamples, 0.5), percentile(stageSamples, 0.95) };
+				results.push_back(result);
+
+				for (size_t r = 0; r < stageSamples.size() && r < totals.size(); r++)
+					totals[r] += stageSamples[r];
+			}
+
+			StageResult total = { dataset, nThreads, "total", nPoints, percentile(totals, 0.5), percentile(totals, 0.95) };
+			results.push_back(total);
+		}
+	}
+
+	// report
+	std::cout << std::left << std::setw(16) << "dataset" << std::right
+		<< std::setw(8) << "threads" << "  " << std::left << std::setw(14) << "stage" << std::right
+		<< std::setw(12) << "median ms"
+		<< std::setw(12) << "p95 ms"
+		<< std::setw(14) << "points/s" << std::endl;
+	std::cout << std::string(16 + 8 + 2 + 14 + 12 + 12 + 14, '-') << std::endl;
+
+	std::streamsize precision = std::cout.precision();
+	std::cout << std::fixed;
+	for (size_t r = 0; r < results.size(); r++)
+	{
+		const StageResult& result = results[r];
+		std::cout << std::left << std::setw(16) << result.dataset << std::right
+			<< std::setw(8) << result.threads << "  " << std::left << std::setw(14) << result.stage << std::right
+			<< std::setprecision(2)
+			<< std::setw(12) << result.median * 1e3
+			<< std::setw(12) << result.p95 * 1e3
+			<< std::setprecision(0)
+			<< std::setw(14) << (result.median > 0 ? result.points / result.median : 0.0) << std::endl;
+	}
+	std::cout.unsetf(std::ios::fixed);
+	std::cout.precision(precision);
+
+	if (!options.saveBaselineFilename.empty())
+	{
+		if (saveBaseline(options.saveBaselineFilename, results))
+			std::cout << "\nSaved baseline to " << options.saveBaselineFilename << std::endl;
+		else
+			std::cerr << "ERROR: the baseline " << options.saveBaselineFilename << " could not be saved!" << std::endl;
+	}
+
+	int status = 0;
+	if (!options.baselineFilename.empty())
+	{
+		std::map<std::string, double> baseline;
+		if (!loadBaseline(options.baselineFilename, baseline))
+		{
+			std::cerr << "ERROR: the baseline " << options.baselineFilename << " could not be read!" << std::endl;
+			return 1;
+		}
+
+		std::cout << "\nComparing against " << options.baselineFilename << " with a tolerance of " << options.tolerance * 100 << "%..." << std::endl;
+
+		for (size_t r = 0; r < results.size(); r++)
+		{
+			const StageResult& result = results[r];
+			std::map<std::string, double>::const_iterator it = baseline.find(resultKey(result.dataset, result.threads, baselineStage(result.stage)));
+			if (it == baseline.end())
+				continue;
+
+			if (result.median > it->second * (1 + options.tolerance) && result.median - it->second > constants::regressionFloor)
+			{
+				std::cout << "REGRESSION " << result.dataset << " threads=" << result.threads << " " << result.stage
+					<< ": " << result.median * 1e3 << " ms vs " << it->second * 1e3 << " ms baseline" << std::endl;
+				status = 2;
+			}
+		}
+
+		if (status == 0)
+			std::cout << "No regressions." << std::endl;
+	}
+
+	return status;
+}
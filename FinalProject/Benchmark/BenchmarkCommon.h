@@ -0,0 +1,42 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+/*
+	splitList
+
+		comma separated command line values
+*/
+
+inline std::vector<std::string> splitList(const std::string& list)
+{
+	std::vector<std::string> items;
+	std::stringstream stream(list);
+	std::string item;
+	while (std::getline(stream, item, ','))
+		if (!item.empty())
+			items.push_back(item);
+	return items;
+}
+
+
+// nearest rank percentile of the samples
+inline double percentile(std::vector<double> samples, double p)
+{
+	std::sort(samples.begin(), samples.end());
+	size_t rank = size_t(std::ceil(p * samples.size()));
+	return samples[std::min(samples.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+
+// seconds since an arbitrary origin, for timing runs
+inline double seconds()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,791 @@
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../FinalProject/NormalEstimation.h"
+#include "../FinalProject/PointCloud.h"
+
+#include "BenchmarkCommon.h"
+
+
+/*
+*	MICRO BENCHMARKS
+*
+*		times the kernels of the normal estimation in
+*		isolation, on synthetic inputs of controlled
+*		size, so the scaling of every component can be
+*		read apart from the rest of the pipeline:
+*
+*			neighbors	getKNeighbors radius queries and
+*						k nearest queries on a noisy
+*						sphere, sweeping N and the
+*						expected neighbors per query
+*
+*			normal		calculateCentroid and
+*						calculateNormal on noisy plane
+*						patches, sweeping k
+*
+*			planes		fitPlane, the plane estimation
+*						of one point with its worker
+*						scratch, against the radius
+*						query and alglib PCA it
+*						replaced, with the heap
+*						allocations of every fit once
+*						warmed up, on the noisy sphere
+*						sweeping N and k
+*
+*			weights		edgeWeights, the batched
+*						Riemannian graph weights of a
+*						neighbor list, against one
+*						edge at a time through the
+*						alglib matrix of normals,
+*						sweeping N and k
+*
+*			mst			primMst on random connected
+*						graphs, sweeping N and the
+*						vertex degree
+*
+*		every configuration reports the median and
+*		p95 time per operation over the repetitions
+*
+*/
+
+
+namespace constants
+{
+	const double noise = 0.01;				// gaussian noise of the synthetic samples, relative to the shape
+	const size_t maxQueries = 20000;		// neighbor queries per repetition, spread over the cloud
+	const size_t normalCalls = 2000;		// plane fits per repetition
+	const size_t normalPatches = 64;		// distinct patches the plane fits cycle over
+	const unsigned int seed = 20181;		// all inputs are reproducible
+}
+
+
+struct Options
+{
+	std::vector<std::string> kernels;
+	std::vector<size_t> sizes;
+	std::vector<size_t> neighbors;
+	std::vector<size_t> graphSizes;
+	std::vector<size_t> degrees;
+	unsigned int repetitions;
+
+	Options() : repetitions(5)
+	{
+		const char *all[] = { "neighbors", "normal", "planes", "weights", "mst" };
+		kernels.assign(all, all + 5);
+
+		const size_t n[] = { 1000, 10000, 100000 };
+		sizes.assign(n, n + 3);
+
+		const size_t k[] = { 8, 16, 32, 64, 128 };
+		neighbors.assign(k, k + 5);
+
+		const size_t g[] = { 500, 1000, 2000, 4000 };
+		graphSizes.assign(g, g + 4);
+
+		const size_t d[] = { 4, 16, 64 };
+		degrees.assign(d, d + 3);
+	}
+};
+
+
+void printUsage(const char *program)
+{
+	std::cout << "usage: " << program << " [options]\n"
+		<< "  --kernels a,b,...     neighbors, normal, planes, weights, mst (all)\n"
+		<< "  --sizes N,...         cloud sizes of the neighbor queries (1000,10000,100000)\n"
+		<< "  --neighbors k,...     expected neighbors per query and patch sizes (8,16,32,64,128)\n"
+		<< "  --graph-sizes N,...   vertices of the MST graphs (500,1000,2000,4000)\n"
+		<< "  --degrees d,...       mean vertex degree of the MST graphs (4,16,64)\n"
+		<< "  --repetitions N       timed runs per configuration (5)\n";
+}
+
+
+std::vector<size_t> parseSizes(const std::string& list)
+{
+	std::vector<size_t> values;
+	std::vector<std::string> items = splitList(list);
+	for (size_t i = 0; i < items.size(); i++)
+		values.push_back(size_t(std::atol(items[i].c_str())));
+	return values;
+}
+
+
+bool parseOptions(int argc, char **argv, Options& options)
+{
+	for (int a = 1; a < argc; a++)
+	{
+		std::string arg = argv[a];
+		if (arg == "--help" || arg == "-h")
+			return false;
+
+		if (a + 1 >= argc)
+		{
+			std::cerr << "ERROR: missing value for " << arg << std::endl;
+			return false;
+		}
+		std::string value = argv[++a];
+
+		if (arg == "--kernels")
+			options.kernels = splitList(value);
+		else if (arg == "--sizes")
+			options.sizes = parseSizes(value);
+		else if (arg == "--neighbors")
+			options.neighbors = parseSizes(value);
+		else if (arg == "--graph-sizes")
+			options.graphSizes = parseSizes(value);
+		else if (arg == "--degrees")
+			options.degrees = parseSizes(value);
+		else if (arg == "--repetitions")
+			options.repetitions = std::max(1, std::atoi(value.c_str()));
+		else
+		{
+			std::cerr << "ERROR: unknown option " << arg << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+	allocation counting
+
+		every heap allocation of the process, so the
+		kernels can be checked to allocate nothing
+		once warmed up. With glibc malloc itself is
+		interposed, which covers operator new and
+		alglib's ae_malloc; elsewhere only operator
+		new is counted.
+*/
+
+std::atomic<size_t> allocations(0);
+
+#if defined(__GLIBC__)
+
+extern "C"
+{
+	void *__libc_malloc(size_t size);
+	void *__libc_calloc(size_t count, size_t size);
+	void *__libc_realloc(void *p, size_t size);
+
+	void *malloc(size_t size)
+	{
+		allocations.fetch_add(1, std::memory_order_relaxed);
+		return __libc_malloc(size);
+	}
+
+	void *calloc(size_t count, size_t size)
+	{
+		allocations.fetch_add(1, std::memory_order_relaxed);
+		return __libc_calloc(count, size);
+	}
+
+	void *realloc(void *p, size_t size)
+	{
+		allocations.fetch_add(1, std::memory_order_relaxed);
+		return __libc_realloc(p, size);
+	}
+}
+
+#else
+
+void *operator new(size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void *p = std::malloc(size > 0 ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	std::free(p);
+}
+
+#endif
+
+
+/*
+	synthetic inputs
+*/
+
+// n points on the unit sphere, uniformly spread, with gaussian noise along the radius
+void sampleSphere(alglib::real_2d_array& points, size_t n, std::mt19937& rng)
+{
+	std::normal_distribution<double> gauss(0.0, 1.0);
+	points.setlength(n, constants::dims);
+
+	for (size_t i = 0; i < n; i++)
+	{
+		double p[3] = { gauss(rng), gauss(rng), gauss(rng) };
+		double norm = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+		double r = 1.0 + constants::noise * gauss(rng);
+		for (size_t d = 0; d < 3; d++)
+			points[i][d] = r * p[d] / norm;
+	}
+}
+
+
+// k points on a random plane through the origin, in the unit square, with gaussian noise along the normal n
+void samplePatch(alglib::real_2d_array& points, size_t k, std::mt19937& rng, double n[3])
+{
+	std::normal_distribution<double> gauss(0.0, 1.0);
+	std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+
+	// orthonormal frame u, v, n of the plane
+	for (size_t d = 0; d < 3; d++)
+		n[d] = gauss(rng);
+	double norm = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+	for (size_t d = 0; d < 3; d++)
+		n[d] /= norm;
+
+	double a[3] = { 1, 0, 0 };
+	if (std::fabs(n[0]) > 0.9)
+		a[0] = 0, a[1] = 1;
+
+	double u[3] = { n[1] * a[2] - n[2] * a[1], n[2] * a[0] - n[0] * a[2], n[0] * a[1] - n[1] * a[0] };
+	norm = std::sqrt(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+	for (size_t d = 0; d < 3; d++)
+		u[d] /= norm;
+
+	double v[3] = { n[1] * u[2] - n[2] * u[1], n[2] * u[0] - n[0] * u[2], n[0] * u[1] - n[1] * u[0] };
+
+	points.setlength(k, constants::dims);
+	for (size_t i = 0; i < k; i++)
+	{
+		double s = uniform(rng), t = uniform(rng), h = constants::noise * gauss(rng);
+		for (size_t d = 0; d < 3; d++)
+			points[i][d] = s * u[d] + t * v[d] + h * n[d];
+	}
+}
+
+
+/*
+	randomGraph
+
+		n vertices with about degree edges per
+		vertex: a path through all the vertices, so
+		the graph is connected, plus random edges.
+		Weights are uniform in [0, 1], like
+		1 - |n_u . n_v|.
+*/
+
+void randomGraph(size_t n, size_t degree, std::mt19937& rng, RiemannianGraph& graph)
+{
+	std::uniform_real_distribution<double> weight(0.0, 1.0);
+	std::uniform_int_distribution<size_t> vertex(0, n - 1);
+
+	std::vector<GraphEdge> edges;
+	for (size_t u = 0; u + 1 < n; u++)
+	{
+		GraphEdge edge = { u, u + 1, weight(rng) };
+		edges.push_back(edge);
+	}
+
+	// the path gives every vertex 2 edges already, repeated edges are dropped when assembling
+	size_t extra = degree > 2 ? n * (degree - 2) / 2 : 0;
+	for (size_t e = 0; e < extra; e++)
+	{
+		size_t u = vertex(rng), v = vertex(rng);
+		if (u == v)
+			continue;
+
+		GraphEdge edge = { u, v, weight(rng) };
+		edges.push_back(edge);
+	}
+
+	assembleGraph(edges, n, graph);
+}
+
+
+/*
+	results
+*/
+
+struct Result
+{
+	std::string kernel;
+	size_t n;
+	std::string parameter;
+	double median;		// seconds per operation
+	double p95;
+	double measured;	// mean neighbors, normal error, ... depending on the kernel
+};
+
+
+void printResults(const std::string& title, const std::string& parameter, const std::string& measured, const std::vector<Result>& results)
+{
+	if (results.empty())
+		return;
+
+	std::cout << "\n" << title << std::endl;
+	std::cout << std::left << std::setw(24) << "kernel" << std::right
+		<< std::setw(10) << "N"
+		<< std::setw(12) << parameter
+		<< std::setw(14) << "median us"
+		<< std::setw(14) << "p95 us"
+		<< std::setw(14) << "ops/s"
+		<< std::setw(14) << measured << std::endl;
+	std::cout << std::string(24 + 10 + 12 + 14 * 4, '-') << std::endl;
+
+	std::ios::fmtflags flags = std::cout.flags();
+	std::streamsize precision = std::cout.precision();
+	std::cout << std::fixed;
+
+	for (size_t r = 0; r < results.size(); r++)
+	{
+		const Result& result = results[r];
+		std::cout << std::left << std::setw(24) << result.kernel << std::right
+			<< std::setw(10) << result.n
+			<< std::setw(12) << result.parameter
+			<< std::setprecision(3)
+			<< std::setw(14) << result.median * 1e6
+			<< std::setw(14) << result.p95 * 1e6
+			<< std::setprecision(0)
+			<< std::setw(14) << (result.median > 0 ? 1 / result.median : 0.0)
+			<< std::setprecision(4)
+			<< std::setw(14) << result.measured << std::endl;
+	}
+
+	std::cout.flags(flags);
+	std::cout.precision(precision);
+}
+
+
+std::string label(const std::string& prefix, size_t value)
+{
+	std::ostringstream text;
+	text << prefix << value;
+	return text.str();
+}
+
+
+/*
+	benchmarkNeighbors
+
+		for every cloud size and expected number of
+		neighbors k, radius queries with the radius
+		that holds k points on average, and k
+		nearest queries, both through a request
+		buffer like the parallel stages do
+*/
+
+void benchmarkNeighbors(const Options& options, std::vector<Result>& results)
+{
+	for (size_t s = 0; s < options.sizes.size(); s++)
+	{
+		size_t n = options.sizes[s];
+		if (n == 0)
+			continue;
+
+		std::mt19937 rng(constants::seed);
+		alglib::real_2d_array points;
+		sampleSphere(points, n, rng);
+
+		double build = seconds();
+		alglib::kdtree kdt;
+		buildKDTree(kdt, points, n);
+		build = seconds() - build;
+
+		Result tree = { "kdtree build", n, "-", build, build, 0.0 };
+		results.push_back(tree);
+
+		alglib::kdtreerequestbuffer buffer;
+		alglib::kdtreecreaterequestbuffer(kdt, buffer);
+
+		size_t nQueries = std::min(n, constants::maxQueries);
+		size_t stride = n / nQueries;
+
+		alglib::real_1d_array query;
+		query.setlength(constants::dims);
+		alglib::real_2d_array neighbors;
+
+		for (size_t c = 0; c < options.neighbors.size(); c++)
+		{
+			size_t k = std::min(options.neighbors[c], n);
+
+			// a sphere cap of radius r holds about n r^2 / 4 points
+			double radius = 2 * std::sqrt(double(k) / n);
+
+			std::vector<double> rnnSamples, knnSamples;
+			double found = 0;
+
+			for (unsigned int run = 0; run < options.repetitions; run++)
+			{
+				size_t total = 0;
+				double begin = seconds();
+				for (size_t q = 0; q < nQueries; q++)
+				{
+					for (size_t d = 0; d < constants::dims; d++)
+						query[d] = points[q * stride][d];
+					total += getKNeighbors(kdt, buffer, neighbors, query, radius);
+				}
+				rnnSamples.push_back((seconds() - begin) / nQueries);
+				found = double(total) / nQueries;
+
+				begin = seconds();
+				for (size_t q = 0; q < nQueries; q++)
+				{
+					for (size_t d = 0; d < constants::dims; d++)
+						query[d] = points[q * stride][d];
+					alglib::ae_int_t m = alglib::kdtreetsqueryknn(kdt, buffer, query, k);
+					neighbors.setlength(m, constants::dims);
+					alglib::kdtreetsqueryresultsx(kdt, buffer, neighbors);
+				}
+				knnSamples.push_back((seconds() - begin) / nQueries);
+			}
+
+			Result rnn = { "kdtree radius", n, label("k=", k), percentile(rnnSamples, 0.5), percentile(rnnSamples, 0.95), found };
+			Result knn = { "kdtree knn", n, label("k=", k), percentile(knnSamples, 0.5), percentile(knnSamples, 0.95), double(k) };
+			results.push_back(rnn);
+			results.push_back(knn);
+		}
+	}
+}
+
+
+/*
+	benchmarkNormal
+
+		centroid and PCA normal of noisy plane
+		patches of k points, with the mean angle
+		between the estimated and the true normal
+		as a sanity check of the solver
+*/
+
+void benchmarkNormal(const Options& options, std::vector<Result>& results)
+{
+	for (size_t c = 0; c < options.neighbors.size(); c++)
+	{
+		size_t k = options.neighbors[c];
+		if (k < constants::dims)
+			continue;
+
+		std::mt19937 rng(constants::seed);
+		std::vector<alglib::real_2d_array> patches(constants::normalPatches);
+		std::vector<double> truth(3 * patches.size());
+		for (size_t p = 0; p < patches.size(); p++)
+			samplePatch(patches[p], k, rng, &truth[3 * p]);
+
+		// mean angle in degrees between the fitted and the true normals, untimed
+		double error = 0;
+		for (size_t p = 0; p < patches.size(); p++)
+		{
+			alglib::real_1d_array normal = calculateNormal(patches[p], k);
+			double dot = std::fabs(normal[0] * truth[3 * p] + normal[1] * truth[3 * p + 1] + normal[2] * truth[3 * p + 2]);
+			error += std::acos(std::min(1.0, dot)) * 180 / std::acos(-1.0);
+		}
+		error /= patches.size();
+
+		std::vector<double> centroidSamples, normalSamples;
+		double checksum = 0;
+
+		for (unsigned int run = 0; run < options.repetitions; run++)
+		{
+			double begin = seconds();
+			for (size_t call = 0; call < constants::normalCalls; call++)
+			{
+				alglib::real_1d_array centroid = calculateCentroid(patches[call % patches.size()], k);
+				checksum += centroid[0];
+			}
+			centroidSamples.push_back((seconds() - begin) / constants::normalCalls);
+
+			begin = seconds();
+			for (size_t call = 0; call < constants::normalCalls; call++)
+			{
+				alglib::real_1d_array normal = calculateNormal(patches[call % patches.size()], k);
+				checksum += normal[0];
+			}
+			normalSamples.push_back((seconds() - begin) / constants::normalCalls);
+		}
+
+		// keep the calls from being optimized away
+		if (checksum == DBL_MAX)
+			std::cout << checksum << std::endl;
+
+		Result centroid = { "calculateCentroid", 1, label("k=", k), percentile(centroidSamples, 0.5), percentile(centroidSamples, 0.95), 0.0 };
+		Result normal = { "calculateNormal pca", 1, label("k=", k), percentile(normalSamples, 0.5), percentile(normalSamples, 0.95), error };
+		results.push_back(centroid);
+		results.push_back(normal);
+	}
+}
+
+
+/*
+	benchmarkPlanes
+
+		for every cloud size and expected number of
+		neighbors k, the plane of nQueries points
+		through fitPlane and through the radius
+		query, calculateCentroid and calculateNormal
+		it replaced, both after a warm up pass, with
+		the heap allocations per plane
+*/
+
+void benchmarkPlanes(const Options& options, std::vector<Result>& results)
+{
+	for (size_t s = 0; s < options.sizes.size(); s++)
+	{
+		size_t n = options.sizes[s];
+		if (n == 0)
+			continue;
+
+		std::mt19937 rng(constants::seed);
+		alglib::real_2d_array points;
+		sampleSphere(points, n, rng);
+
+		alglib::kdtree kdt;
+		buildKDTree(kdt, points, n);
+
+		size_t nQueries = std::min(n, constants::maxQueries);
+		size_t stride = n / nQueries;
+
+		for (size_t c = 0; c < options.neighbors.size(); c++)
+		{
+			size_t k = std::min(options.neighbors[c], n);
+			double radius = 2 * std::sqrt(double(k) / n);
+
+			PlaneScratch scratch(kdt);
+			double centroid[3], normal[3], checksum = 0;
+
+			alglib::kdtreerequestbuffer buffer;
+			alglib::kdtreecreaterequestbuffer(kdt, buffer);
+			alglib::real_1d_array query;
+			query.setlength(constants::dims);
+			alglib::real_2d_array neighbors;
+
+			// warm up, growing the scratch to the largest neighborhood
+			for (size_t q = 0; q < nQueries; q++)
+				fitPlane(kdt, scratch, points[q * stride], radius, centroid, normal);
+
+			std::vector<double> fitSamples, pcaSamples;
+			size_t fitAllocations = 0, pcaAllocations = 0;
+
+			for (unsigned int run = 0; run < options.repetitions; run++)
+			{
+				size_t before = allocations.load();
+				double begin = seconds();
+				for (size_t q = 0; q < nQueries; q++)
+				{
+					fitPlane(kdt, scratch, points[q * stride], radius, centroid, normal);
+					checksum += normal[0];
+				}
+				fitAllocations += allocations.load() - before;
+				fitSamples.push_back((seconds() - begin) / nQueries);
+
+				before = allocations.load();
+				begin = seconds();
+				for (size_t q = 0; q < nQueries; q++)
+				{
+					for (size_t d = 0; d < constants::dims; d++)
+						query[d] = points[q * stride][d];
+					alglib::ae_int_t m = getKNeighbors(kdt, buffer, neighbors, query, radius);
+					alglib::real_1d_array pcaCentroid = calculateCentroid(neighbors, m);
+					alglib::real_1d_array pcaNormal = calculateNormal(neighbors, m);
+					checksum += pcaCentroid[0] + pcaNormal[0];
+				}
+				pcaAllocations += allocations.load() - before;
+				pcaSamples.push_back((seconds() - begin) / nQueries);
+			}
+
+			// keep the calls from being optimized away
+			if (checksum == DBL_MAX)
+				std::cout << checksum << std::endl;
+
+			double fits = double(nQueries) * options.repetitions;
+			Result fit = { "fitPlane scratch", n, label("k=", k), percentile(fitSamples, 0.5), percentile(fitSamples, 0.95), fitAllocations / fits };
+			Result pca = { "query + alglib pca", n, label("k=", k), percentile(pcaSamples, 0.5), percentile(pcaSamples, 0.95), pcaAllocations / fits };
+			results.push_back(fit);
+			results.push_back(pca);
+		}
+	}
+}
+
+
+/*
+	benchmarkWeights
+
+		for every number of normals and neighbors k,
+		the weights of nQueries vertices to k random
+		neighbors each, batched by edgeWeights and
+		one edge at a time through the alglib matrix,
+		with the largest difference between the two
+*/
+
+void benchmarkWeights(const Options& options, std::vector<Result>& results)
+{
+	for (size_t s = 0; s < options.sizes.size(); s++)
+	{
+		size_t n = options.sizes[s];
+		if (n == 0)
+			continue;
+
+		// random directions of about unit length, in both layouts
+		std::mt19937 rng(constants::seed);
+		alglib::real_2d_array normals;
+		sampleSphere(normals, n, rng);
+
+		Vec3Arrays arrays(n);
+		for (size_t i = 0; i < n; i++)
+			arrays.set(i, normals[i]);
+
+		size_t nQueries = std::min(n, constants::maxQueries);
+		size_t stride = n / nQueries;
+		std::uniform_int_distribution<alglib::ae_int_t> vertex(0, alglib::ae_int_t(n) - 1);
+
+		for (size_t c = 0; c < options.neighbors.size(); c++)
+		{
+			size_t k = options.neighbors[c];
+
+			std::vector<alglib::ae_int_t> neighbors(nQueries * k);
+			for (size_t j = 0; j < neighbors.size(); j++)
+				neighbors[j] = vertex(rng);
+
+			std::vector<double> batched(nQueries * k), single(nQueries * k);
+			std::vector<double> batchedSamples, singleSamples;
+
+			for (unsigned int run = 0; run < options.repetitions; run++)
+			{
+				double begin = seconds();
+				for (size_t q = 0; q < nQueries; q++)
+					edgeWeights(arrays.x(), arrays.y(), arrays.z(), q * stride, &neighbors[q * k], k, &batched[q * k]);
+				batchedSamples.push_back((seconds() - begin) / (nQueries * k));
+
+				begin = seconds();
+				for (size_t q = 0; q < nQueries; q++)
+				{
+					size_t u = q * stride;
+					for (size_t j = 0; j < k; j++)
+					{
+						size_t v = size_t(neighbors[q * k + j]);
+						double dot = normals[u][0] * normals[v][0] + normals[u][1] * normals[v][1] + normals[u][2] * normals[v][2];
+						single[q * k + j] = 1 - std::abs(dot);
+					}
+				}
+				singleSamples.push_back((seconds() - begin) / (nQueries * k));
+			}
+
+			double difference = 0;
+			for (size_t j = 0; j < batched.size(); j++)
+				difference = std::max(difference, std::abs(batched[j] - single[j]));
+
+			Result batch = { "edgeWeights batched", n, label("k=", k), percentile(batchedSamples, 0.5), percentile(batchedSamples, 0.95), difference };
+			Result edge = { "per edge alglib", n, label("k=", k), percentile(singleSamples, 0.5), percentile(singleSamples, 0.95), difference };
+			results.push_back(batch);
+			results.push_back(edge);
+		}
+	}
+}
+
+
+/*
+	benchmarkMst
+
+		primMst on random connected graphs of n
+		vertices and the given mean degree
+*/
+
+void benchmarkMst(const Options& options, std::vector<Result>& results)
+{
+	for (size_t s = 0; s < options.graphSizes.size(); s++)
+	{
+		size_t n = options.graphSizes[s];
+		if (n < 2)
+			continue;
+
+		for (size_t g = 0; g < options.degrees.size(); g++)
+		{
+			size_t degree = std::min(options.degrees[g], n - 1);
+
+			std::mt19937 rng(constants::seed);
+			RiemannianGraph graph;
+			randomGraph(n, degree, rng, graph);
+			size_t *parent = new size_t[n];
+
+			std::vector<double> samples;
+			for (unsigned int run = 0; run < options.repetitions; run++)
+			{
+				double begin = seconds();
+				primMst(graph, parent);
+				samples.push_back(seconds() - begin);
+			}
+
+			Result mst = { "primMst", n, label("d=", degree), percentile(samples, 0.5), percentile(samples, 0.95), double(graph.nEdges()) };
+			results.push_back(mst);
+
+			delete[] parent;
+		}
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	Options options;
+	if (!parseOptions(argc, argv, options))
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	for (size_t k = 0; k < options.kernels.size(); k++)
+	{
+		std::vector<Result> results;
+		const std::string& kernel = options.kernels[k];
+
+		if (kernel == "neighbors")
+		{
+			benchmarkNeighbors(options, results);
+			printResults("Neighbor queries (per query, N points on a noisy unit sphere)", "neighbors", "found", results);
+		}
+		else if (kernel == "normal")
+		{
+			benchmarkNormal(options, results);
+			printResults("Plane fits (per call, k points on a noisy plane patch)", "neighbors", "error deg", results);
+		}
+		else if (kernel == "planes")
+		{
+			benchmarkPlanes(options, results);
+			printResults("Plane estimation (per point, N points on a noisy unit sphere)", "neighbors", "allocs", results);
+		}
+		else if (kernel == "weights")
+		{
+			benchmarkWeights(options, results);
+			printResults("Edge weights (per edge, k random neighbors of N random normals)", "neighbors", "max diff", results);
+		}
+		else if (kernel == "mst")
+		{
+			benchmarkMst(options, results);
+			printResults("Minimum spanning tree (per tree, random connected graphs)", "degree", "edges", results);
+		}
+		else
+		{
+			std::cerr << "ERROR: unknown kernel " << kernel << std::endl;
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,132 @@
+#include "AlglibArena.h"
+
+#include <cstdlib>
+#include <new>
+
+
+namespace
+{
+	const size_t npos = size_t(-1);
+	const size_t granularity = 16;	// bytes, keeps every header and block 16 byte aligned
+
+	// in front of every block of the stack
+	struct BlockHeader
+	{
+		size_t previous;	// offset of the header of the block under it, npos for the first
+		size_t freed;
+	};
+}
+
+
+struct AlglibArena::Buffer
+{
+	alglib_impl::ae_allocator allocator;
+	char *memory;
+	size_t capacity;
+	size_t top;			// first free byte
+	size_t last;		// offset of the header of the top block, npos when empty
+	size_t live;		// blocks not freed yet
+	bool orphaned;		// the arena is gone, the last block frees the buffer
+
+	BlockHeader *header(size_t offset) { return reinterpret_cast<BlockHeader*>(memory + offset); }
+
+	static void *allocate(void *context, size_t size);
+	static void release(void *context, void *block);
+	static void destroy(Buffer *buffer);
+};
+
+void *AlglibArena::Buffer::allocate(void *context, size_t size)
+{
+	Buffer *buffer = static_cast<Buffer*>(context);
+
+	size_t bytes = sizeof(BlockHeader) + (size + granularity - 1) / granularity * granularity;
+	if (bytes > buffer->capacity / 4 || bytes > buffer->capacity - buffer->top)
+		return NULL;
+
+	BlockHeader *header = buffer->header(buffer->top);
+	header->previous = buffer->last;
+	header->freed = 0;
+
+	buffer->last = buffer->top;
+	buffer->top += bytes;
+	buffer->live++;
+	return header + 1;
+}
+
+void AlglibArena::Buffer::release(void *context, void *block)
+{
+	Buffer *buffer = static_cast<Buffer*>(context);
+
+	static_cast<BlockHeader*>(block)[-1].freed = 1;
+	buffer->live--;
+
+	// pop the freed blocks off the top
+	while (buffer->last != npos && buffer->header(buffer->last)->freed)
+	{
+		buffer->top = buffer->last;
+		buffer->last = buffer->header(buffer->last)->previous;
+	}
+
+	if (buffer->orphaned && buffer->live == 0)
+		destroy(buffer);
+}
+
+void AlglibArena::Buffer::destroy(Buffer *buffer)
+{
+	std::free(buffer->memory);
+	delete buffer;
+}
+
+
+AlglibArena::AlglibArena(size_t capacity) : buffer(new Buffer)
+{
+	buffer->allocator.allocate = Buffer::allocate;
+	buffer->allocator.release = Buffer::release;
+	buffer->allocator.context = buffer;
+	buffer->capacity = capacity / granularity * granularity;
+	buffer->memory = static_cast<char*>(std::malloc(buffer->capacity));
+	buffer->top = 0;
+	buffer->last = npos;
+	buffer->live = 0;
+	buffer->orphaned = false;
+
+	if (!buffer->memory)
+	{
+		delete buffer;
+		throw std::bad_alloc();
+	}
+}
+
+AlglibArena::~AlglibArena()
+{
+	if (buffer->live == 0)
+		Buffer::destroy(buffer);
+	else
+		buffer->orphaned = true;
+}
+
+size_t AlglibArena::capacity() const
+{
+	return buffer->capacity;
+}
+
+size_t AlglibArena::used() const
+{
+	return buffer->top;
+}
+
+size_t AlglibArena::blocks() const
+{
+	return buffer->live;
+}
+
+
+AlglibArenaScope::AlglibArenaScope(AlglibArena& arena) : previous(alglib_impl::ae_get_thread_allocator())
+{
+	alglib_impl::ae_set_thread_allocator(&arena.buffer->allocator);
+}
+
+AlglibArenaScope::~AlglibArenaScope()
+{
+	alglib_impl::ae_set_thread_allocator(previous);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+
+#include "Libraries/alglib/ap.h"
+
+
+namespace constants
+{
+	const size_t alglibArenaCapacity = 1 << 20;	// bytes per arena, blocks over a quarter of it go to the heap
+}
+
+
+/*
+	AlglibArena
+
+		Stack allocator for the temporaries of
+		alglib: while an AlglibArenaScope installs
+		it on a thread, the ae_vector and ae_matrix
+		blocks alglib allocates there are carved
+		from one buffer, allocated once, instead of
+		the heap. Freeing the top block of the stack
+		gives its bytes back, along with the blocks
+		under it already freed, so the temporaries
+		of a call, freed when alglib leaves its
+		frame, leave room for the next call. Blocks
+		over a quarter of the capacity, or when the
+		buffer is full, come from the heap.
+
+		Meant for one worker of a hot loop, e.g. a
+		transform or a query per grid line or point.
+		Blocks must be freed on the thread which
+		allocated them; they may outlive the arena,
+		the last one releases the buffer then.
+*/
+
+class AlglibArena
+{
+public:
+	explicit AlglibArena(size_t capacity = constants::alglibArenaCapacity);
+	~AlglibArena();
+
+	size_t capacity() const;
+	size_t used() const;		// bytes on the stack, freed blocks included until popped
+	size_t blocks() const;		// blocks not freed yet
+
+private:
+	struct Buffer;
+	Buffer *buffer;
+
+	friend class AlglibArenaScope;
+
+	AlglibArena(const AlglibArena&);
+	AlglibArena& operator=(const AlglibArena&);
+};
+
+
+/*
+	AlglibArenaScope
+
+		Installs an arena as the alglib allocator of
+		the calling thread for its lifetime, and
+		restores the previous one after.
+*/
+
+class AlglibArenaScope
+{
+public:
+	explicit AlglibArenaScope(AlglibArena& arena);
+	~AlglibArenaScope();
+
+private:
+	alglib_impl::ae_allocator *previous;
+
+	AlglibArenaScope(const AlglibArenaScope&);
+	AlglibArenaScope& operator=(const AlglibArenaScope&);
+};
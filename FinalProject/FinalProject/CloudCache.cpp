@@ -0,0 +1,408 @@
+#include "CloudCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <setjmp.h>
+#include <vector>
+
+#include "MappedFile.h"
+
+
+namespace
+{
+	const char cacheMagic[8] = { 'F', 'P', 'C', 'L', 'O', 'U', 'D', '\0' };
+	const uint32_t byteOrderTag = 0x01020304;
+	const uint64_t sectionAlignment = 64;
+
+	enum CacheSection
+	{
+		SECTION_POINTS = 1,			// double, nPoints x 3
+		SECTION_KDTREE_SHAPE,		// int64 n, nx, ny, normtype
+		SECTION_KDTREE_XY,			// double, n x (2 nx + ny)
+		SECTION_KDTREE_TAGS,		// int64
+		SECTION_KDTREE_BOXMIN,		// double
+		SECTION_KDTREE_BOXMAX,		// double
+		SECTION_KDTREE_NODES,		// int64
+		SECTION_KDTREE_SPLITS		// double
+	};
+
+	struct CacheHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t byteOrder;
+		uint64_t key;
+		uint64_t nPoints;
+		uint32_t nSections;
+		uint32_t reserved;
+	};
+
+	struct CacheSectionEntry
+	{
+		uint32_t kind;
+		uint32_t elementSize;
+		uint64_t rows;
+		uint64_t cols;
+		uint64_t offset;			// from the start of the file, aligned
+	};
+
+
+	// a section waiting to be written
+	struct PendingSection
+	{
+		CacheSectionEntry entry;
+		std::vector<char> bytes;
+	};
+
+	template <typename T>
+	void addSection(std::vector<PendingSection>& sections, uint32_t kind, uint64_t rows, uint64_t cols, const T *values)
+	{
+		PendingSection section;
+		section.entry.kind = kind;
+		section.entry.elementSize = sizeof(T);
+		section.entry.rows = rows;
+		section.entry.cols = cols;
+		section.entry.offset = 0;
+
+		const char *begin = reinterpret_cast<const char*>(values);
+		section.bytes.assign(begin, begin + rows * cols * sizeof(T));
+		sections.push_back(section);
+	}
+
+	// alglib matrices pad their rows, sections are dense
+	void addMatrixSection(std::vector<PendingSection>& sections, uint32_t kind, const alglib_impl::ae_matrix& matrix)
+	{
+		std::vector<double> dense(size_t(matrix.rows) * size_t(matrix.cols));
+		for (alglib_impl::ae_int_t r = 0; r < matrix.rows; r++)
+			std::memcpy(&dense[size_t(r) * size_t(matrix.cols)], matrix.ptr.pp_double[r], size_t(matrix.cols) * sizeof(double));
+		addSection(sections, kind, uint64_t(matrix.rows), uint64_t(matrix.cols), dense.data());
+	}
+
+	void addIntegerSection(std::vector<PendingSection>& sections, uint32_t kind, const alglib_impl::ae_vector& vector)
+	{
+		std::vector<int64_t> values(vector.ptr.p_int, vector.ptr.p_int + vector.cnt);
+		addSection(sections, kind, uint64_t(vector.cnt), 1, values.data());
+	}
+
+	void addRealSection(std::vector<PendingSection>& sections, uint32_t kind, const alglib_impl::ae_vector& vector)
+	{
+		addSection(sections, kind, uint64_t(vector.cnt), 1, vector.ptr.p_double);
+	}
+
+	uint64_t aligned(uint64_t offset)
+	{
+		return (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+	}
+
+
+	// the sections of a mapped cache, NULL when missing or malformed
+	class CacheReader
+	{
+	public:
+		CacheReader(const MappedFile& file, const CacheHeader& header)
+			: file(file), entries(reinterpret_cast<const CacheSectionEntry*>(file.data() + sizeof(CacheHeader))), nEntries(header.nSections) {}
+
+		const CacheSectionEntry *find(uint32_t kind, uint32_t elementSize, uint64_t rows, uint64_t cols) const
+		{
+			for (uint32_t s = 0; s < nEntries; s++)
+			{
+				const CacheSectionEntry& entry = entries[s];
+				if (entry.kind != kind)
+					continue;
+
+				bool valid = entry.elementSize == elementSize && (rows == 0 || entry.rows == rows) && (cols == 0 || entry.cols == cols)
+					&& entry.offset % sectionAlignment == 0 && entry.offset <= file.size()
+					&& (entry.cols == 0 || entry.rows <= (file.size() - entry.offset) / elementSize / entry.cols);
+				return valid ? &entry : NULL;
+			}
+			return NULL;
+		}
+
+		template <typename T>
+		const T *data(const CacheSectionEntry& entry) const
+		{
+			return reinterpret_cast<const T*>(file.data() + entry.offset);
+		}
+
+	private:
+		const MappedFile& file;
+		const CacheSectionEntry *entries;
+		uint32_t nEntries;
+	};
+
+	/*
+		validTree
+
+			Walks the cached nodes the way alglib's
+			queries do: a leaf holds a point count and
+			the first point, a split its dimension, the
+			index of its split value and the offsets of
+			its children. Children always follow their
+			parent, so the walk cannot loop, and a tree
+			has no more nodes than fit in the array.
+	*/
+
+	bool validTree(const int64_t *nodes, uint64_t nNodes, uint64_t nSplits, int64_t n, int64_t nx)
+	{
+		const uint64_t leafSize = 2, splitSize = 5;	// entries read per node, alglib leaves room for 6 at a split
+
+		std::vector<uint64_t> pending(1, 0);
+		for (uint64_t visited = 0; !pending.empty(); visited++)
+		{
+			uint64_t offset = pending.back();
+			pending.pop_back();
+			if (visited >= nNodes / leafSize || offset >= nNodes || nNodes - offset < leafSize)
+				return false;
+
+			const int64_t *node = nodes + offset;
+			if (node[0] > 0)
+			{
+				if (node[1] < 0 || node[1] > n || node[0] > n - node[1])
+					return false;
+				continue;
+			}
+
+			if (node[0] < 0 || nNodes - offset < splitSize
+				|| node[1] < 0 || node[1] >= nx || node[2] < 0 || uint64_t(node[2]) >= nSplits)
+				return false;
+
+			for (size_t child = 3; child < 5; child++)
+			{
+				if (node[child] <= int64_t(offset))
+					return false;
+				pending.push_back(uint64_t(node[child]));
+			}
+		}
+		return true;
+	}
+
+	bool loadIndex(const CacheReader& reader, uint64_t nPoints, alglib::kdtree& kdt)
+	{
+		const CacheSectionEntry *shape = reader.find(SECTION_KDTREE_SHAPE, sizeof(int64_t), 4, 1);
+		if (!shape)
+			return false;
+
+		const int64_t *nxyNorm = reader.data<int64_t>(*shape);
+		const CacheSectionEntry *xy = reader.find(SECTION_KDTREE_XY, sizeof(double), uint64_t(nxyNorm[0]), 0);
+		const CacheSectionEntry *tags = reader.find(SECTION_KDTREE_TAGS, sizeof(int64_t), 0, 1);
+		const CacheSectionEntry *boxmin = reader.find(SECTION_KDTREE_BOXMIN, sizeof(double), 0, 1);
+		const CacheSectionEntry *boxmax = reader.find(SECTION_KDTREE_BOXMAX, sizeof(double), 0, 1);
+		const CacheSectionEntry *nodes = reader.find(SECTION_KDTREE_NODES, sizeof(int64_t), 0, 1);
+		const CacheSectionEntry *splits = reader.find(SECTION_KDTREE_SPLITS, sizeof(double), 0, 1);
+		if (!xy || !tags || !boxmin || !boxmax || !nodes || !splits)
+			return false;
+
+		// a tree of points like the pipeline's, with arrays sized for it, or the queries would read out of bounds
+		int64_t n = nxyNorm[0], nx = nxyNorm[1], ny = nxyNorm[2];
+		if (n < 0 || uint64_t(n) != nPoints || nx != int64_t(constants::dims) || ny != 0 || nxyNorm[3] != int64_t(constants::kdtTreeNormType)
+			|| xy->rows != uint64_t(n) || xy->cols != uint64_t(2 * nx + ny) || tags->rows != uint64_t(n)
+			|| boxmin->rows != uint64_t(nx) || boxmax->rows != uint64_t(nx) || nodes->rows == 0)
+			return false;
+
+		// their contents too, the cache has no checksum and the queries trust every offset and tag
+		if (!validTree(reader.data<int64_t>(*nodes), nodes->rows, splits->rows, n, nx))
+			return false;
+
+		const int64_t *tagValues = reader.data<int64_t>(*tags);
+		for (uint64_t i = 0; i < tags->rows; i++)
+			if (tagValues[i] < 0 || tagValues[i] >= n)
+				return false;
+
+		// the arrays of the tree, as alglib's own unserializer fills them
+		jmp_buf breakJump;
+		alglib_impl::ae_state state;
+		alglib_impl::ae_state_init(&state);
+		if (setjmp(breakJump))
+		{
+			alglib_impl::ae_state_clear(&state);
+			return false;
+		}
+		alglib_impl::ae_state_set_break_jump(&state, &breakJump);
+
+		alglib_impl::kdtree *tree = kdt.c_ptr();
+		tree->n = alglib_impl::ae_int_t(nxyNorm[0]);
+		tree->nx = alglib_impl::ae_int_t(nxyNorm[1]);
+		tree->ny = alglib_impl::ae_int_t(nxyNorm[2]);
+		tree->normtype = alglib_impl::ae_int_t(nxyNorm[3]);
+
+		alglib_impl::ae_matrix_set_length(&tree->xy, alglib_impl::ae_int_t(xy->rows), alglib_impl::ae_int_t(xy->cols), &state);
+		const double *xyValues = reader.data<double>(*xy);
+		for (uint64_t r = 0; r < xy->rows; r++)
+			std::memcpy(tree->xy.ptr.pp_double[r], xyValues + r * xy->cols, size_t(xy->cols) * sizeof(double));
+
+		const CacheSectionEntry *integers[] = { tags, nodes };
+		alglib_impl::ae_vector *integerVectors[] = { &tree->tags, &tree->nodes };
+		for (int v = 0; v < 2; v++)
+		{
+			alglib_impl::ae_vector_set_length(integerVectors[v], alglib_impl::ae_int_t(integers[v]->rows), &state);
+			const int64_t *values = reader.data<int64_t>(*integers[v]);
+			for (uint64_t i = 0; i < integers[v]->rows; i++)
+				integerVectors[v]->ptr.p_int[i] = alglib_impl::ae_int_t(values[i]);
+		}
+
+		const CacheSectionEntry *reals[] = { boxmin, boxmax, splits };
+		alglib_impl::ae_vector *realVectors[] = { &tree->boxmin, &tree->boxmax, &tree->splits };
+		for (int v = 0; v < 3; v++)
+		{
+			alglib_impl::ae_vector_set_length(realVectors[v], alglib_impl::ae_int_t(reals[v]->rows), &state);
+			if (reals[v]->rows > 0)
+				std::memcpy(realVectors[v]->ptr.p_double, reader.data<double>(*reals[v]), size_t(reals[v]->rows) * sizeof(double));
+		}
+
+		alglib_impl::kdtreecreaterequestbuffer(tree, &tree->innerbuf, &state);
+		alglib_impl::ae_state_clear(&state);
+		return true;
+	}
+}
+
+
+bool cloudCacheKey(const std::string& filename, CloudFormat format, uint64_t& key)
+{
+	MappedFile file;
+	if (!file.open(filename))
+		return false;
+
+	if (format == FORMAT_UNKNOWN)
+		format = detectCloudFormat(filename);
+
+	// FNV-1a over the contents, then the format
+	uint64_t hash = 14695981039346656037ULL;
+	const uint64_t prime = 1099511628211ULL;
+
+	const unsigned char *bytes = reinterpret_cast<const unsigned char*>(file.data());
+	for (size_t i = 0; i < file.size(); i++)
+		hash = (hash ^ bytes[i]) * prime;
+
+	hash = (hash ^ uint64_t(format)) * prime;
+
+	key = hash;
+	return true;
+}
+
+
+std::string cloudCacheFilename(const std::string& directory, uint64_t key)
+{
+	char name[17];
+	std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+
+	std::string path = directory;
+	if (!path.empty() && path[path.size() - 1] != '/' && path[path.size() - 1] != '\\')
+		path += '/';
+	return path + name + constants::cloudCacheExtension;
+}
+
+
+bool saveCloudCache(const std::string& filename, uint64_t key, const alglib::real_2d_array& points, size_t nPoints, const alglib::kdtree *kdt)
+{
+	std::vector<PendingSection> sections;
+
+	std::vector<double> coordinates(nPoints * constants::dims);
+	for (size_t i = 0; i < nPoints; i++)
+		for (size_t d = 0; d < constants::dims; d++)
+			coordinates[i * constants::dims + d] = points[i][d];
+	addSection(sections, SECTION_POINTS, nPoints, constants::dims, coordinates.data());
+
+	if (kdt)
+	{
+		const alglib_impl::kdtree *tree = kdt->c_ptr();
+		int64_t shape[] = { tree->n, tree->nx, tree->ny, tree->normtype };
+		addSection(sections, SECTION_KDTREE_SHAPE, 4, 1, shape);
+		addMatrixSection(sections, SECTION_KDTREE_XY, tree->xy);
+		addIntegerSection(sections, SECTION_KDTREE_TAGS, tree->tags);
+		addRealSection(sections, SECTION_KDTREE_BOXMIN, tree->boxmin);
+		addRealSection(sections, SECTION_KDTREE_BOXMAX, tree->boxmax);
+		addIntegerSection(sections, SECTION_KDTREE_NODES, tree->nodes);
+		addRealSection(sections, SECTION_KDTREE_SPLITS, tree->splits);
+	}
+
+	CacheHeader header;
+	std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+	header.version = constants::cloudCacheVersion;
+	header.byteOrder = byteOrderTag;
+	header.key = key;
+	header.nPoints = nPoints;
+	header.nSections = uint32_t(sections.size());
+	header.reserved = 0;
+
+	uint64_t offset = sizeof(CacheHeader) + sections.size() * sizeof(CacheSectionEntry);
+	for (size_t s = 0; s < sections.size(); s++)
+	{
+		offset = aligned(offset);
+		sections[s].entry.offset = offset;
+		offset += sections[s].bytes.size();
+	}
+
+	// written to a temporary and renamed, a concurrent run never maps a partial cache
+	std::string temporary = filename + ".tmp";
+	{
+		std::ofstream out(temporary.c_str(), std::ios::binary);
+		if (!out)
+			return false;
+
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		for (size_t s = 0; s < sections.size(); s++)
+			out.write(reinterpret_cast<const char*>(&sections[s].entry), sizeof(CacheSectionEntry));
+
+		const char padding[sectionAlignment] = {};
+		uint64_t written = sizeof(CacheHeader) + sections.size() * sizeof(CacheSectionEntry);
+		for (size_t s = 0; s < sections.size(); s++)
+		{
+			out.write(padding, std::streamsize(sections[s].entry.offset - written));
+			out.write(sections[s].bytes.data(), std::streamsize(sections[s].bytes.size()));
+			written = sections[s].entry.offset + sections[s].bytes.size();
+		}
+
+		if (!out)
+		{
+			out.close();
+			std::remove(temporary.c_str());
+			return false;
+		}
+	}
+
+	std::remove(filename.c_str());
+	if (std::rename(temporary.c_str(), filename.c_str()) != 0)
+	{
+		std::remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+
+bool loadCloudCache(const std::string& filename, uint64_t key, alglib::real_2d_array& points, size_t& nPoints, alglib::kdtree *kdt, bool& hasIndex)
+{
+	hasIndex = false;
+
+	MappedFile file;
+	if (!file.open(filename) || file.size() < sizeof(CacheHeader))
+		return false;
+
+	CacheHeader header;
+	std::memcpy(&header, file.data(), sizeof(header));
+
+	if (std::memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 || header.version != constants::cloudCacheVersion
+		|| header.byteOrder != byteOrderTag || header.key != key
+		|| header.nSections > (file.size() - sizeof(CacheHeader)) / sizeof(CacheSectionEntry))
+		return false;
+
+	CacheReader reader(file, header);
+
+	const CacheSectionEntry *pointsSection = reader.find(SECTION_POINTS, sizeof(double), header.nPoints, constants::dims);
+	if (!pointsSection)
+		return false;
+
+	// alglib arrays own their storage, the sections are copied out of the mapping
+	nPoints = size_t(header.nPoints);
+	points.setlength(nPoints, constants::dims);
+	const double *coordinates = reader.data<double>(*pointsSection);
+	for (size_t i = 0; i < nPoints; i++)
+		for (size_t d = 0; d < constants::dims; d++)
+			points[i][d] = coordinates[i * constants::dims + d];
+
+	if (kdt)
+		hasIndex = loadIndex(reader, header.nPoints, *kdt);
+
+	return true;
+}
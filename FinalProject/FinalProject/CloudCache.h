@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// alglib nearest neighbor subpackage for kdtree
+#include "Libraries/alglib/alglibmisc.h"
+
+#include "PointCloud.h"
+
+
+/*
+	Cloud cache
+
+		A versioned binary file holding a loaded
+		cloud and, once built, its kdtree, so repeated
+		runs and parameter sweeps on the same scan
+		skip parsing the input and building the index.
+
+		The file is a fixed header followed by a
+		table of sections, each a raw array in the
+		byte order of the machine that wrote it,
+		aligned to 64 bytes, so the whole file
+		can be mapped and every section read in
+		place. Unknown sections are skipped: new ones
+		can be added without a new version, changing
+		an existing one needs one.
+
+		Caches are keyed by cloudCacheKey, a hash of
+		the contents and format of the input, and a
+		cache with another key, version or byte order
+		is ignored.
+*/
+
+namespace constants
+{
+	const uint32_t cloudCacheVersion = 1;
+	const std::string cloudCacheExtension = ".fpcache";
+}
+
+
+/*
+	cloudCacheKey
+
+		64-bit FNV-1a hash of the input file and the
+		format it is read as (detected unless given),
+		false if the file can't be read.
+*/
+
+bool cloudCacheKey(const std::string& filename, CloudFormat format, uint64_t& key);
+
+
+/*
+	cloudCacheFilename
+
+		<directory>/<key in hex>.fpcache
+*/
+
+std::string cloudCacheFilename(const std::string& directory, uint64_t key);
+
+
+/*
+	saveCloudCache
+
+		Writes the points and, if given, their kdtree
+		(built on the same points) under key.
+*/
+
+bool saveCloudCache(const std::string& filename, uint64_t key, const alglib::real_2d_array& points, size_t nPoints, const alglib::kdtree *kdt = NULL);
+
+
+/*
+	loadCloudCache
+
+		Reads the points back and the kdtree, when
+		the cache has one and kdt is given; hasIndex
+		tells which. False, with the outputs
+		untouched, if the file is missing, stale,
+		from another version or corrupt.
+*/
+
+bool loadCloudCache(const std::string& filename, uint64_t key, alglib::real_2d_array& points, size_t& nPoints, alglib::kdtree *kdt, bool& hasIndex);
@@ -0,0 +1,293 @@
+#include "Contouring.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+#include "Parallel.h"
+
+
+namespace
+{
+	// cell corner c sits at offset (c & 1, (c >> 1) & 1, (c >> 2) & 1)
+	const int cornerOffsets[8][3] = {
+		{ 0, 0, 0 }, { 1, 0, 0 }, { 0, 1, 0 }, { 1, 1, 0 },
+		{ 0, 0, 1 }, { 1, 0, 1 }, { 0, 1, 1 }, { 1, 1, 1 }
+	};
+
+	// six tetrahedra sharing the 0-7 diagonal, conforming between cells
+	const int cellTetrahedra[6][4] = {
+		{ 0, 1, 3, 7 }, { 0, 3, 2, 7 }, { 0, 2, 6, 7 },
+		{ 0, 6, 4, 7 }, { 0, 4, 5, 7 }, { 0, 5, 1, 7 }
+	};
+
+	struct Contourer
+	{
+		const ScalarGrid& grid;
+		TriangleMesh& mesh;
+		std::unordered_map<unsigned long long, size_t> edgeVertices;
+
+		Contourer(const ScalarGrid& g, TriangleMesh& m) : grid(g), mesh(m) {}
+
+		void nodePosition(size_t node, double *p) const
+		{
+			size_t x = node % grid.dims[0];
+			size_t y = (node / grid.dims[0]) % grid.dims[1];
+			size_t z = node / (grid.dims[0] * grid.dims[1]);
+			p[0] = grid.origin[0] + grid.cellSize * x;
+			p[1] = grid.origin[1] + grid.cellSize * y;
+			p[2] = grid.origin[2] + grid.cellSize * z;
+		}
+
+		// vertex where the zero set crosses the grid edge (a, b)
+		size_t edgeVertex(size_t a, size_t b)
+		{
+			if (a > b)
+				std::swap(a, b);
+
+			double fa = grid.values[a], fb = grid.values[b];
+
+			// a crossing exactly on a node is shared by all the edges around it
+			unsigned long long key = (unsigned long long)a * grid.nNodes() + b;
+			if (fa == 0)
+				key = (unsigned long long)a * grid.nNodes() + a;
+			else if (fb == 0)
+				key = (unsigned long long)b * grid.nNodes() + b;
+
+			std::unordered_map<unsigned long long, size_t>::iterator it = edgeVertices.find(key);
+			if (it != edgeVertices.end())
+				return it->second;
+
+			double pa[3], pb[3];
+			nodePosition(a, pa);
+			nodePosition(b, pb);
+
+			double t = fa / (fa - fb);
+
+			size_t v = mesh.nVertices();
+			for (size_t d = 0; d < 3; d++)
+				mesh.vertices.push_back(pa[d] + t * (pb[d] - pa[d]));
+
+			edgeVertices[key] = v;
+			return v;
+		}
+
+		// wind (a, b, c) so that its normal points from inside to outside
+		void emit(size_t a, size_t b, size_t c, size_t inside, size_t outside)
+		{
+			// degenerate triangles collapse onto a grid node
+			if (a == b || b == c || a == c)
+				return;
+
+			const double *pa = &mesh.vertices[a * 3];
+			const double *pb = &mesh.vertices[b * 3];
+			const double *pc = &mesh.vertices[c * 3];
+
+			double u[3], w[3], n[3], pi[3], po[3];
+			for (size_t d = 0; d < 3; d++)
+			{
+				u[d] = pb[d] - pa[d];
+				w[d] = pc[d] - pa[d];
+			}
+			n[0] = u[1] * w[2] - u[2] * w[1];
+			n[1] = u[2] * w[0] - u[0] * w[2];
+			n[2] = u[0] * w[1] - u[1] * w[0];
+
+			nodePosition(inside, pi);
+			nodePosition(outside, po);
+
+			double dot = 0;
+			for (size_t d = 0; d < 3; d++)
+				dot += n[d] * (po[d] - pi[d]);
+
+			mesh.faces.push_back(a);
+			if (dot >= 0)
+			{
+				mesh.faces.push_back(b);
+				mesh.faces.push_back(c);
+			}
+			else
+			{
+				mesh.faces.push_back(c);
+				mesh.faces.push_back(b);
+			}
+		}
+
+		void tetrahedron(const size_t *nodes)
+		{
+			size_t in[4], out[4], nIn = 0, nOut = 0;
+
+			for (size_t i = 0; i < 4; i++)
+			{
+				double f = grid.values[nodes[i]];
+				if (std::isnan(f))
+					return;
+
+				if (f < 0)
+					in[nIn++] = nodes[i];
+				else
+					out[nOut++] = nodes[i];
+			}
+
+			if (nIn == 1)
+			{
+				emit(edgeVertex(in[0], out[0]), edgeVertex(in[0], out[1]), edgeVertex(in[0], out[2]), in[0], out[0]);
+			}
+			else if (nIn == 3)
+			{
+				emit(edgeVertex(out[0], in[0]), edgeVertex(out[0], in[1]), edgeVertex(out[0], in[2]), in[0], out[0]);
+			}
+			else if (nIn == 2)
+			{
+				// the crossing is a quad split along one diagonal
+				size_t a = edgeVertex(in[0], out[0]);
+				size_t b = edgeVertex(in[0], out[1]);
+				size_t c = edgeVertex(in[1], out[1]);
+				size_t d = edgeVertex(in[1], out[0]);
+				emit(a, b, c, in[0], out[0]);
+				emit(a, c, d, in[0], out[0]);
+			}
+		}
+	};
+}
+
+
+void initGrid(ScalarGrid& grid, const Vec3View& points, double cellSize, size_t margin)
+{
+	double lo[3], hi[3];
+	for (size_t d = 0; d < 3; d++)
+	{
+		lo[d] = std::numeric_limits<double>::max();
+		hi[d] = -std::numeric_limits<double>::max();
+	}
+
+	for (size_t i = 0; i < points.size; i++)
+		for (size_t d = 0; d < 3; d++)
+		{
+			lo[d] = std::min(lo[d], points(i, d));
+			hi[d] = std::max(hi[d], points(i, d));
+		}
+
+	grid.cellSize = cellSize;
+	for (size_t d = 0; d < 3; d++)
+	{
+		grid.origin[d] = lo[d] - cellSize * margin;
+		grid.dims[d] = size_t(std::ceil((hi[d] - lo[d]) / cellSize)) + 2 * margin + 1;
+	}
+
+	grid.values.assign(grid.nNodes(), std::numeric_limits<double>::quiet_NaN());
+}
+
+
+void sampleSignedDistance(
+	ScalarGrid& grid,
+	const alglib::kdtree& kdtCentroids,
+	const Vec3Arrays& centroids,
+	const Vec3Arrays& normals,
+	const alglib::kdtree& kdtPoints,
+	double maxDistance,
+	unsigned int nThreads)
+{
+	parallelFor(grid.nNodes(), [&](size_t begin, size_t end, unsigned int)
+	{
+		// kdtree queries keep their state in the request buffer
+		alglib::kdtreerequestbuffer centroidsBuffer, pointsBuffer;
+		alglib::kdtreecreaterequestbuffer(kdtCentroids, centroidsBuffer);
+		alglib::kdtreecreaterequestbuffer(kdtPoints, pointsBuffer);
+
+		alglib::real_1d_array query, distances;
+		alglib::integer_1d_array tags;
+		query.setlength(3);
+
+		for (size_t node = begin; node < end; node++)
+		{
+			size_t x = node % grid.dims[0];
+			size_t y = (node / grid.dims[0]) % grid.dims[1];
+			size_t z = node / (grid.dims[0] * grid.dims[1]);
+
+			double p[3] = {
+				grid.origin[0] + grid.cellSize * x,
+				grid.origin[1] + grid.cellSize * y,
+				grid.origin[2] + grid.cellSize * z
+			};
+
+			// closest tangent plane
+			for (size_t d = 0; d < 3; d++)
+				query[d] = p[d];
+			alglib::kdtreetsqueryknn(kdtCentroids, centroidsBuffer, query, 1);
+			alglib::kdtreetsqueryresultstags(kdtCentroids, centroidsBuffer, tags);
+			size_t i = size_t(tags[0]);
+
+			double f = 0;
+			for (size_t d = 0; d < 3; d++)
+				f += (p[d] - centroids(i, d)) * normals(i, d);
+
+			// project p onto the plane and check it lands near the data
+			for (size_t d = 0; d < 3; d++)
+				query[d] = p[d] - f * normals(i, d);
+			alglib::kdtreetsqueryknn(kdtPoints, pointsBuffer, query, 1);
+			alglib::kdtreetsqueryresultsdistances(kdtPoints, pointsBuffer, distances);
+
+			if (distances[0] < maxDistance)
+				grid.values[node] = f;
+		}
+	}, nThreads);
+}
+
+
+void trimGrid(ScalarGrid& grid, const alglib::kdtree& kdtPoints, double maxDistance, unsigned int nThreads)
+{
+	parallelFor(grid.nNodes(), [&](size_t begin, size_t end, unsigned int)
+	{
+		alglib::kdtreerequestbuffer pointsBuffer;
+		alglib::kdtreecreaterequestbuffer(kdtPoints, pointsBuffer);
+
+		alglib::real_1d_array query, distances;
+		query.setlength(3);
+
+		for (size_t node = begin; node < end; node++)
+		{
+			size_t x = node % grid.dims[0];
+			size_t y = (node / grid.dims[0]) % grid.dims[1];
+			size_t z = node / (grid.dims[0] * grid.dims[1]);
+
+			query[0] = grid.origin[0] + grid.cellSize * x;
+			query[1] = grid.origin[1] + grid.cellSize * y;
+			query[2] = grid.origin[2] + grid.cellSize * z;
+
+			alglib::kdtreetsqueryknn(kdtPoints, pointsBuffer, query, 1);
+			alglib::kdtreetsqueryresultsdistances(kdtPoints, pointsBuffer, distances);
+
+			if (distances[0] >= maxDistance)
+				grid.values[node] = std::numeric_limits<double>::quiet_NaN();
+		}
+	}, nThreads);
+}
+
+
+void contourGrid(const ScalarGrid& grid, TriangleMesh& mesh)
+{
+	mesh.vertices.clear();
+	mesh.faces.clear();
+
+	Contourer contourer(grid, mesh);
+
+	for (size_t z = 0; z + 1 < grid.dims[2]; z++)
+		for (size_t y = 0; y + 1 < grid.dims[1]; y++)
+			for (size_t x = 0; x + 1 < grid.dims[0]; x++)
+			{
+				size_t corners[8];
+				for (size_t c = 0; c < 8; c++)
+					corners[c] = grid.index(x + cornerOffsets[c][0], y + cornerOffsets[c][1], z + cornerOffsets[c][2]);
+
+				for (size_t t = 0; t < 6; t++)
+				{
+					size_t nodes[4];
+					for (size_t i = 0; i < 4; i++)
+						nodes[i] = corners[cellTetrahedra[t][i]];
+
+					contourer.tetrahedron(nodes);
+				}
+			}
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <vector>
+
+#include "Libraries/alglib/alglibmisc.h"
+
+#include "Mesh.h"
+#include "PointArrays.h"
+
+
+/*
+	ScalarGrid
+
+		Implicit function sampled on the nodes of a
+		regular grid. Node (x, y, z) is stored at
+		x + dims[0] * (y + dims[1] * z) and sits at
+		origin + cellSize * (x, y, z).
+
+		Nodes where the function is undefined hold
+		NaN and are skipped by the contouring.
+*/
+
+struct ScalarGrid
+{
+	double origin[3];
+	double cellSize;
+	size_t dims[3];
+	std::vector<double> values;
+
+	size_t nNodes() const { return dims[0] * dims[1] * dims[2]; }
+	size_t index(size_t x, size_t y, size_t z) const { return x + dims[0] * (y + dims[1] * z); }
+};
+
+
+/*
+	ImplicitFunction
+
+		Implicit functions the reconstruction can
+		contour, all sampled on a ScalarGrid and
+		positive outside the surface.
+*/
+
+enum ImplicitFunction
+{
+	SIGNED_DISTANCE,	// Hoppe's distance to the tangent planes
+	POISSON_INDICATOR,	// Kazhdan's indicator function, see PoissonReconstruction.h
+	RBF_INTERPOLANT		// Carr's RBF implicit surface, see RbfReconstruction.h
+};
+
+
+/*
+	initGrid
+
+		Sizes the grid to cover the bounding box
+		of the points plus a margin of cells on
+		every side. Values are left undefined.
+*/
+
+void initGrid(ScalarGrid& grid, const Vec3View& points, double cellSize, size_t margin = 1);
+
+
+/*
+	sampleSignedDistance
+
+		Evaluates Hoppe's signed distance to the
+		tangent planes on every grid node:
+
+			f(p) = (p - o_i) . n_i
+
+		where o_i is the centroid closest to p. The
+		value is undefined when the projection of p
+		onto that plane is farther than maxDistance
+		from the input points, so no surface is
+		produced away from the data.
+
+		Nodes are evaluated in parallel, every worker
+		with its own kdtree request buffers.
+*/
+
+void sampleSignedDistance(
+	ScalarGrid& grid,
+	const alglib::kdtree& kdtCentroids,
+	const Vec3Arrays& centroids,
+	const Vec3Arrays& normals,
+	const alglib::kdtree& kdtPoints,
+	double maxDistance,
+	unsigned int nThreads = 0);
+
+
+/*
+	trimGrid
+
+		Marks undefined the nodes farther than
+		maxDistance from the input points, for
+		implicit functions that are defined
+		everywhere but only meaningful near the
+		data (open scans would otherwise be closed
+		by a surface far from any sample).
+*/
+
+void trimGrid(ScalarGrid& grid, const alglib::kdtree& kdtPoints, double maxDistance, unsigned int nThreads = 0);
+
+
+/*
+	contourGrid
+
+		Extracts the zero set of the grid as a
+		triangle mesh with marching tetrahedra
+		(every cell split in six tetrahedra around
+		its main diagonal, which avoids the
+		ambiguous cases of marching cubes).
+
+		Vertices lying on the same grid edge are
+		shared, and faces are wound so that their
+		normals point towards positive values.
+*/
+
+void contourGrid(const ScalarGrid& grid, TriangleMesh& mesh);
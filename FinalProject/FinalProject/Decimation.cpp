@@ -0,0 +1,829 @@
+#include "Decimation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+
+
+namespace
+{
+	typedef std::uint32_t index_t;
+
+	inline void cross(const double *u, const double *v, double *n)
+	{
+		n[0] = u[1] * v[2] - u[2] * v[1];
+		n[1] = u[2] * v[0] - u[0] * v[2];
+		n[2] = u[0] * v[1] - u[1] * v[0];
+	}
+
+	inline double dot(const double *u, const double *v)
+	{
+		return u[0] * v[0] + u[1] * v[1] + u[2] * v[2];
+	}
+
+	// starts loading the cache line of p ahead of its use, does nothing without SSE
+	inline void prefetch(const void *p)
+	{
+#if defined(__SSE__) || defined(_M_X64)
+		_mm_prefetch(static_cast<const char*>(p), _MM_HINT_T0);
+#else
+		(void)p;
+#endif
+	}
+
+	/*
+		Quadric
+
+			Symmetric 4x4 error quadric of a set of
+			planes, Q(p) = p'Ap + 2b'p + c.
+	*/
+
+	struct Quadric
+	{
+		double a11, a12, a13, a22, a23, a33;
+		double b1, b2, b3;
+		double c;
+
+		Quadric() : a11(0), a12(0), a13(0), a22(0), a23(0), a33(0), b1(0), b2(0), b3(0), c(0) {}
+
+		// plane n.p + d = 0 with unit n
+		void addPlane(const double *n, double d, double w)
+		{
+			a11 += w * n[0] * n[0]; a12 += w * n[0] * n[1]; a13 += w * n[0] * n[2];
+			a22 += w * n[1] * n[1]; a23 += w * n[1] * n[2];
+			a33 += w * n[2] * n[2];
+			b1 += w * d * n[0]; b2 += w * d * n[1]; b3 += w * d * n[2];
+			c += w * d * d;
+		}
+
+		Quadric& operator+=(const Quadric& q)
+		{
+			a11 += q.a11; a12 += q.a12; a13 += q.a13;
+			a22 += q.a22; a23 += q.a23;
+			a33 += q.a33;
+			b1 += q.b1; b2 += q.b2; b3 += q.b3;
+			c += q.c;
+			return *this;
+		}
+
+		double evaluate(const double *p) const
+		{
+			double x = p[0], y = p[1], z = p[2];
+			double e = a11 * x * x + 2 * a12 * x * y + 2 * a13 * x * z
+				+ a22 * y * y + 2 * a23 * y * z
+				+ a33 * z * z
+				+ 2 * (b1 * x + b2 * y + b3 * z)
+				+ c;
+
+			// rounding can push the error slightly below zero
+			return e > 0 ? e : 0;
+		}
+
+		// solves A p = -b by Cramer's rule
+		bool minimizer(double *p) const
+		{
+			double c11 = a22 * a33 - a23 * a23;
+			double c12 = a13 * a23 - a12 * a33;
+			double c13 = a12 * a23 - a13 * a22;
+			double det = a11 * c11 + a12 * c12 + a13 * c13;
+
+			if (std::fabs(det) < 1e-12)
+				return false;
+
+			double c22 = a11 * a33 - a13 * a13;
+			double c23 = a12 * a13 - a11 * a23;
+			double c33 = a11 * a22 - a12 * a12;
+
+			p[0] = -(c11 * b1 + c12 * b2 + c13 * b3) / det;
+			p[1] = -(c12 * b1 + c22 * b2 + c23 * b3) / det;
+			p[2] = -(c13 * b1 + c23 * b2 + c33 * b3) / det;
+			return true;
+		}
+	};
+
+	const index_t dead = index_t(-1);	// first index of a removed face or edge
+	const double stale = -1;			// cost of an edge whose ends changed since
+	const double rejected = std::numeric_limits<double>::infinity();	// cost of an edge that cannot collapse for now
+
+	/*
+		Adjacency
+
+			Compact per vertex lists of incident faces
+			and edges, one array per kind. A vertex whose
+			list changes gets it rewritten at the end of
+			the array; the lists left behind are dropped
+			by compactIfNeeded() once they pile up. Lists
+			may still hold removed faces and edges.
+
+			Both list heads of a vertex share one record,
+			so visiting a vertex touches one cache line.
+	*/
+
+	enum { FACES = 0, EDGES = 1 };
+
+	struct Adjacency
+	{
+		struct Heads
+		{
+			index_t start[2], count[2];
+		};
+
+		std::vector<Heads> heads;
+		std::vector<index_t> refs[2], spare[2];
+		size_t built[2];
+
+		// elements are arity consecutive vertex indices each
+		void build(int kind, size_t nVertices, const index_t *elements, size_t nElements, size_t arity)
+		{
+			heads.resize(nVertices);
+
+			std::vector<index_t> fill(nVertices + 1, 0);
+			for (size_t i = 0; i < nElements * arity; i++)
+				fill[elements[i] + 1]++;
+
+			for (size_t v = 0; v < nVertices; v++)
+			{
+				heads[v].start[kind] = fill[v];
+				heads[v].count[kind] = fill[v + 1];
+				fill[v + 1] += fill[v];
+			}
+
+			// room for the lists rewritten until the next compaction
+			refs[kind].reserve(2 * size_t(fill[nVertices]));
+			refs[kind].resize(fill[nVertices]);
+			for (size_t i = 0; i < nElements * arity; i++)
+				refs[kind][fill[elements[i]]++] = index_t(i / arity);
+
+			built[kind] = refs[kind].size();
+		}
+
+		const index_t *begin(int kind, size_t v) const { return refs[kind].data() + heads[v].start[kind]; }
+		const index_t *end(int kind, size_t v) const { return begin(kind, v) + heads[v].count[kind]; }
+
+		void assign(int kind, size_t v, const std::vector<index_t>& items)
+		{
+			heads[v].start[kind] = index_t(refs[kind].size());
+			heads[v].count[kind] = index_t(items.size());
+			refs[kind].insert(refs[kind].end(), items.begin(), items.end());
+		}
+
+		void clear(size_t v)
+		{
+			heads[v].count[FACES] = heads[v].count[EDGES] = 0;
+		}
+
+		void compactIfNeeded(int kind)
+		{
+			if (refs[kind].size() < 2 * built[kind])
+				return;
+
+			// the buffer left by the last compaction is reused, it has room until the next one
+			std::vector<index_t>& packed = spare[kind];
+			packed.clear();
+			packed.reserve(2 * built[kind]);
+
+			for (size_t v = 0; v < heads.size(); v++)
+			{
+				index_t first = index_t(packed.size());
+				packed.insert(packed.end(), begin(kind, v), end(kind, v));
+				heads[v].start[kind] = first;
+			}
+
+			refs[kind].swap(packed);
+			built[kind] = refs[kind].size();
+		}
+	};
+
+	class Decimator
+	{
+	public:
+		explicit Decimator(TriangleMesh& m) : mesh(m) {}
+
+		size_t run(size_t targetFaces, double maxError)
+		{
+			init();
+
+			size_t collapses = 0;
+			while (nAliveFaces > targetFaces)
+			{
+				double threshold;
+				if (!nextThreshold(targetFaces, threshold))
+					break;
+
+				bool capped = maxError > 0 && threshold >= maxError;
+				if (capped)
+					threshold = maxError;
+
+				size_t done = sweep(targetFaces, threshold);
+				collapses += done;
+
+				// nothing under the bound can change anymore
+				if (capped && done == 0)
+					break;
+			}
+
+			compactMesh();
+			return collapses;
+		}
+
+	private:
+		enum
+		{
+			BOUNDARY = 1,	// on an open boundary
+			REJECTED = 2	// may have rejected edges
+		};
+
+		TriangleMesh& mesh;
+
+		std::vector<index_t> faces;		// 3 per face, the first dead once removed
+		std::vector<index_t> edges;		// 2 per edge, the first dead once removed
+
+		std::vector<Quadric> quadrics;
+		std::vector<unsigned char> flags;
+
+		Adjacency adjacency;
+
+		std::vector<double> costs;				// per edge, stale or rejected until needed again
+		std::vector<index_t> candidates;		// edges in sweep order, the dead ones pruned while sweeping
+		std::vector<double> samples;
+
+		std::vector<index_t> marks;			// per vertex, one more past the last for dead edges
+		index_t stamp;
+
+		size_t nAliveFaces;
+
+		// alive faces and edges around the edge last passed by canCollapse(), for collapse()
+		std::vector<index_t> facesOnEdge, facesA, facesB, edgesA, edgesB;
+
+		double *position(size_t v) { return &mesh.vertices[v * 3]; }
+
+		bool faceAlive(size_t f) const { return faces[f * 3] != dead; }
+		bool edgeAlive(size_t e) const { return edges[e * 2] != dead; }
+
+		size_t other(size_t e, size_t v) const { return edges[e * 2] ^ edges[e * 2 + 1] ^ v; }
+
+		bool faceHas(size_t f, size_t v) const
+		{
+			const index_t *face = &faces[f * 3];
+			return (face[0] == v) | (face[1] == v) | (face[2] == v);
+		}
+
+		void init()
+		{
+			size_t nVertices = mesh.nVertices();
+			size_t nFaces = mesh.nFaces();
+
+			faces.assign(mesh.faces.begin(), mesh.faces.end());
+			adjacency.build(FACES, nVertices, faces.data(), nFaces, 3);
+
+			std::vector<unsigned char> boundaryCorners(nFaces, 0);
+			buildEdges(boundaryCorners);
+
+			size_t nEdges = edges.size() / 2;
+			adjacency.build(EDGES, nVertices, edges.data(), nEdges, 2);
+
+			flags.assign(nVertices, 0);
+			quadrics.assign(nVertices, Quadric());
+			marks.assign(nVertices + 1, 0);
+			stamp = 0;
+			nAliveFaces = nFaces;
+
+			// area weighted face planes
+			for (size_t f = 0; f < nFaces; f++)
+			{
+				const index_t *face = &faces[f * 3];
+				double n[3];
+				faceNormal(face, n);
+
+				double len = std::sqrt(dot(n, n));
+				if (len == 0)
+					continue;
+
+				for (size_t d = 0; d < 3; d++)
+					n[d] /= len;
+
+				double d = -dot(n, position(face[0]));
+				for (size_t i = 0; i < 3; i++)
+					quadrics[face[i]].addPlane(n, d, len / 2);
+			}
+
+			// open boundaries are held by planes perpendicular to their face
+			for (size_t f = 0; f < nFaces; f++)
+			{
+				if (!boundaryCorners[f])
+					continue;
+
+				const index_t *face = &faces[f * 3];
+				double n[3];
+				faceNormal(face, n);
+
+				for (size_t i = 0; i < 3; i++)
+				{
+					if (!(boundaryCorners[f] & (1 << i)))
+						continue;
+
+					size_t a = face[i], b = face[(i + 1) % 3];
+
+					double edge[3], perp[3];
+					for (size_t d = 0; d < 3; d++)
+						edge[d] = position(b)[d] - position(a)[d];
+					cross(edge, n, perp);
+
+					double len = std::sqrt(dot(perp, perp));
+					if (len == 0)
+						continue;
+
+					for (size_t d = 0; d < 3; d++)
+						perp[d] /= len;
+
+					double d = -dot(perp, position(a));
+					double w = constants::boundaryPenalty * dot(edge, edge);
+					quadrics[a].addPlane(perp, d, w);
+					quadrics[b].addPlane(perp, d, w);
+					flags[a] |= BOUNDARY;
+					flags[b] |= BOUNDARY;
+				}
+			}
+
+			costs.assign(nEdges, stale);
+			candidates.resize(nEdges);
+			for (size_t e = 0; e < nEdges; e++)
+				candidates[e] = index_t(e);
+		}
+
+		double edgeCost(size_t e)
+		{
+			if (costs[e] < 0)
+				costs[e] = cost(e);
+			return costs[e];
+		}
+
+		/*
+			Cost under which the next pass collapses
+			about decimationPassShare of the collapses
+			still needed, estimated on every stride-th
+			candidate. Falls back to all the candidates
+			when the sample has no edge left to try;
+			false once there is none at all.
+		*/
+
+		bool nextThreshold(size_t targetFaces, double& threshold)
+		{
+			size_t stride = candidates.size() / constants::decimationSamples + 1;
+			for (;;)
+			{
+				samples.clear();
+				for (size_t i = 0; i < candidates.size(); i += stride)
+				{
+					index_t e = candidates[i];
+					if (edgeAlive(e) && costs[e] != rejected)
+						samples.push_back(edgeCost(e));
+				}
+
+				if (!samples.empty())
+					break;
+				if (stride == 1)
+					return false;
+				stride = 1;
+			}
+
+			// an interior collapse removes two faces
+			double wanted = constants::decimationPassShare * double(nAliveFaces - targetFaces) / 2;
+			size_t k = std::min(size_t(wanted / double(stride)), samples.size() - 1);
+
+			std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+			threshold = samples[k];
+			return true;
+		}
+
+		// collapses the candidates up to threshold in order, returns how many
+		size_t sweep(size_t targetFaces, double threshold)
+		{
+			size_t collapses = 0, kept = 0, i = 0;
+			for (; i < candidates.size() && nAliveFaces > targetFaces; i++)
+			{
+				// the ends of the edges coming up are loaded while this one is handled, their lists
+				// a bit later once the heads are in; kept inline, GCC drops calls to functions
+				// that only prefetch
+				if (i + 16 < candidates.size())
+				{
+					size_t ahead = candidates[i + 16];
+					if (edgeAlive(ahead))
+						for (size_t k = 0; k < 2; k++)
+						{
+							size_t v = edges[ahead * 2 + k];
+							prefetch(&adjacency.heads[v]);
+							prefetch(position(v));
+							prefetch(&quadrics[v]);
+							prefetch(&quadrics[v].c);	// quadrics straddle two cache lines
+						}
+
+					ahead = candidates[i + 8];
+					if (edgeAlive(ahead))
+					{
+						size_t v = edges[ahead * 2 + 1];
+						prefetch(adjacency.begin(FACES, v));
+						prefetch(adjacency.begin(EDGES, v));
+					}
+				}
+
+				size_t e = candidates[i];
+				if (!edgeAlive(e))
+					continue;
+
+				candidates[kept++] = index_t(e);
+				if (edgeCost(e) > threshold)
+					continue;
+
+				// the same point the cost was computed with, edges do not keep it
+				double target[3];
+				collapseCost(e, target);
+
+				// rejected edges come back once their neighborhood changes
+				if (!canCollapse(e, target))
+				{
+					costs[e] = rejected;
+					flags[edges[e * 2]] |= REJECTED;
+					flags[edges[e * 2 + 1]] |= REJECTED;
+					continue;
+				}
+
+				collapse(e, target);
+				collapses++;
+
+				adjacency.compactIfNeeded(FACES);
+				adjacency.compactIfNeeded(EDGES);
+			}
+
+			// keep the candidates the sweep did not reach
+			candidates.erase(std::copy(candidates.begin() + i, candidates.end(), candidates.begin() + kept), candidates.end());
+			return collapses;
+		}
+
+		/*
+			Lists the edges in the order of meshEdges,
+			walking the faces around each vertex instead
+			of sorting them all. Edge i of a face runs from
+			its corner i to the next; that bit is set in
+			boundaryCorners when no other face has the edge.
+		*/
+
+		void buildEdges(std::vector<unsigned char>& boundaryCorners)
+		{
+			struct Neighbor
+			{
+				index_t w, nFaces, face, corner;
+			};
+
+			std::vector<Neighbor> neighbors;
+			edges.clear();
+			edges.reserve(2 * faces.size());	// every face adds at most three edges
+
+			for (size_t v = 0; v < mesh.nVertices(); v++)
+			{
+				neighbors.clear();
+				for (const index_t *r = adjacency.begin(FACES, v); r != adjacency.end(FACES, v); r++)
+				{
+					const index_t *face = &faces[*r * 3];
+					size_t i = face[0] == v ? 0 : (face[1] == v ? 1 : 2);
+
+					// the edges leaving and entering corner i
+					Neighbor sides[2] = {
+						{ face[(i + 1) % 3], 1, *r, index_t(i) },
+						{ face[(i + 2) % 3], 1, *r, index_t((i + 2) % 3) }
+					};
+
+					// kept sorted by w, there are only a few
+					for (size_t s = 0; s < 2; s++)
+					{
+						if (sides[s].w <= v)
+							continue;
+
+						size_t k = 0;
+						while (k < neighbors.size() && neighbors[k].w < sides[s].w)
+							k++;
+
+						if (k < neighbors.size() && neighbors[k].w == sides[s].w)
+							neighbors[k].nFaces++;
+						else
+							neighbors.insert(neighbors.begin() + k, sides[s]);
+					}
+				}
+
+				for (size_t k = 0; k < neighbors.size(); k++)
+				{
+					edges.push_back(index_t(v));
+					edges.push_back(neighbors[k].w);
+
+					if (neighbors[k].nFaces == 1)
+						boundaryCorners[neighbors[k].face] |= 1 << neighbors[k].corner;
+				}
+			}
+		}
+
+		void faceNormal(const index_t *face, double *n)
+		{
+			double u[3], v[3];
+			for (size_t d = 0; d < 3; d++)
+			{
+				u[d] = position(face[1])[d] - position(face[0])[d];
+				v[d] = position(face[2])[d] - position(face[0])[d];
+			}
+			cross(u, v, n);
+		}
+
+		double cost(size_t e)
+		{
+			double target[3];
+			return collapseCost(e, target);
+		}
+
+		// error at the best collapse position of e, which goes to target
+		double collapseCost(size_t e, double *target)
+		{
+			size_t a = edges[e * 2], b = edges[e * 2 + 1];
+			Quadric q = quadrics[a];
+			q += quadrics[b];
+
+			const double *pa = position(a), *pb = position(b);
+			double mid[3];
+			for (size_t d = 0; d < 3; d++)
+				mid[d] = (pa[d] + pb[d]) / 2;
+
+			// the optimum is only trusted near the edge, ill-conditioned quadrics throw it far away;
+			// when it is, no other point can do better
+			if (q.minimizer(target))
+			{
+				double reach = 0, offset = 0;
+				for (size_t d = 0; d < 3; d++)
+				{
+					reach += (pb[d] - pa[d]) * (pb[d] - pa[d]);
+					offset += (target[d] - mid[d]) * (target[d] - mid[d]);
+				}
+
+				// A target = -b there, so the error is b'target + c
+				if (offset <= reach)
+				{
+					double error = q.b1 * target[0] + q.b2 * target[1] + q.b3 * target[2] + q.c;
+					return error > 0 ? error : 0;
+				}
+			}
+
+			const double *best = mid;
+			double bestCost = q.evaluate(mid);
+
+			// the ends can only do better than a midpoint that has some error, flat spots have none
+			if (bestCost > 0)
+			{
+				double ca = q.evaluate(pa), cb = q.evaluate(pb);
+				if (ca < bestCost) { best = pa; bestCost = ca; }
+				if (cb < bestCost) { best = pb; bestCost = cb; }
+			}
+
+			for (size_t d = 0; d < 3; d++)
+				target[d] = best[d];
+
+			return bestCost;
+		}
+
+		// whether moving v to target flips one of its faces off the edge,
+		// through is set when one of them has both corners
+		bool flips(size_t v, const std::vector<index_t>& around, const double *target, const size_t *corners, bool& through)
+		{
+			const double *p = position(v);
+			for (size_t k = 0; k < around.size(); k++)
+			{
+				size_t f = around[k];
+				through |= faceHas(f, corners[0]) & faceHas(f, corners[1]);
+
+				// both normals are taken against the edge across from v, found without branching
+				const index_t *face = &faces[f * 3];
+				size_t i = (face[1] == v) + 2 * (face[2] == v);
+				const double *x = position(face[(i + 1) % 3]), *y = position(face[(i + 2) % 3]);
+
+				double across[3], u0[3], u1[3], n0[3], n1[3];
+				for (size_t d = 0; d < 3; d++)
+				{
+					across[d] = y[d] - x[d];
+					u0[d] = x[d] - p[d];
+					u1[d] = x[d] - target[d];
+				}
+				cross(u0, across, n0);
+				cross(u1, across, n1);
+
+				// a face shrunk to nothing flips too; the cosine bound goes without the square root
+				double l0 = dot(n0, n0), l1 = dot(n1, n1), c = dot(n0, n1);
+				if ((l1 <= 1e-12 * l0) | (c < 0) | (c * c < constants::decimationMinCosine * constants::decimationMinCosine * l0 * l1))
+					return true;
+			}
+
+			return false;
+		}
+
+
+		bool canCollapse(size_t e, const double *target)
+		{
+			size_t a = edges[e * 2], b = edges[e * 2 + 1];
+
+			// the lists are gathered without branching on what each entry holds, written every
+			// time and kept by moving the end; marks past the last vertex take the dead edges
+			const index_t *fa = adjacency.begin(FACES, a);
+			size_t n = adjacency.end(FACES, a) - fa, nOn = 0, nA = 0;
+			facesOnEdge.resize(n);
+			facesA.resize(n);
+			for (size_t k = 0; k < n; k++)
+			{
+				size_t f = fa[k];
+				bool alive = faceAlive(f), on = faceHas(f, b);
+				facesOnEdge[nOn] = index_t(f);
+				facesA[nA] = index_t(f);
+				nOn += alive & on;
+				nA += alive & !on;
+			}
+			facesOnEdge.resize(nOn);
+			facesA.resize(nA);
+
+			size_t shared = nOn;
+			if (shared == 0 || shared > 2)
+				return false;
+
+			// an interior edge between two boundaries would pinch the surface
+			if (shared == 2 && (flags[a] & flags[b] & BOUNDARY))
+				return false;
+
+			// link condition: the common neighbors are exactly the opposite corners
+			const size_t sink = marks.size() - 1;
+			stamp++;
+			const index_t *ea = adjacency.begin(EDGES, a);
+			n = adjacency.end(EDGES, a) - ea;
+			edgesA.resize(n);
+			nA = 0;
+			for (size_t k = 0; k < n; k++)
+			{
+				size_t r = ea[k];
+				bool alive = edgeAlive(r);
+				marks[alive ? other(r, a) : sink] = stamp;
+				edgesA[nA] = index_t(r);
+				nA += alive;
+			}
+			edgesA.resize(nA);
+
+			size_t common = 0, corners[3] = { dead, dead, dead };
+			const index_t *eb = adjacency.begin(EDGES, b);
+			n = adjacency.end(EDGES, b) - eb;
+			edgesB.resize(n);
+			size_t nB = 0;
+			for (size_t k = 0; k < n; k++)
+			{
+				size_t r = eb[k];
+				bool alive = edgeAlive(r);
+				size_t x = alive ? other(r, b) : sink;
+				bool hit = alive & (marks[x] == stamp);
+				corners[hit ? std::min(common, size_t(2)) : 2] = x;
+				common += hit;
+				edgesB[nB] = index_t(r);
+				nB += alive;
+			}
+			edgesB.resize(nB);
+
+			if (common != shared)
+				return false;
+
+			const index_t *fb = adjacency.begin(FACES, b);
+			n = adjacency.end(FACES, b) - fb;
+			facesB.resize(n);
+			nB = 0;
+			for (size_t k = 0; k < n; k++)
+			{
+				size_t f = fb[k];
+				facesB[nB] = index_t(f);
+				nB += faceAlive(f) & !faceHas(f, a);
+			}
+			facesB.resize(nB);
+
+			bool throughA = false, throughB = false;
+			if (flips(a, facesA, target, corners, throughA) || flips(b, facesB, target, corners, throughB))
+				return false;
+
+			// faces of a and b sharing their opposite edge would fold into a double face,
+			// and that edge can only join the two common neighbors
+			return !(throughA && throughB);
+		}
+
+		// merges b into a at the edge target, e must have just passed canCollapse()
+		void collapse(size_t e, const double *target)
+		{
+			size_t a = edges[e * 2], b = edges[e * 2 + 1];
+
+			for (size_t k = 0; k < facesOnEdge.size(); k++)
+				faces[facesOnEdge[k] * 3] = dead;
+			nAliveFaces -= facesOnEdge.size();
+
+			for (size_t k = 0; k < facesB.size(); k++)
+			{
+				index_t *face = &faces[facesB[k] * 3];
+				for (size_t i = 0; i < 3; i++)
+					face[i] = face[i] == b ? index_t(a) : face[i];
+			}
+
+			facesA.insert(facesA.end(), facesB.begin(), facesB.end());
+			adjacency.assign(FACES, a, facesA);
+
+			// merge the edge fans, dropping b's edges to the neighbors a has, still marked by canCollapse()
+			edges[e * 2] = dead;
+			edgesA.erase(std::find(edgesA.begin(), edgesA.end(), index_t(e)));
+
+			for (size_t k = 0; k < edgesB.size(); k++)
+			{
+				size_t eb = edgesB[k];
+				if (eb == e)
+					continue;
+
+				if (marks[other(eb, b)] == stamp)
+				{
+					edges[eb * 2] = dead;
+					continue;
+				}
+
+				if (edges[eb * 2] == b)
+					edges[eb * 2] = index_t(a);
+				else
+					edges[eb * 2 + 1] = index_t(a);
+
+				edgesA.push_back(index_t(eb));
+			}
+
+			adjacency.assign(EDGES, a, edgesA);
+			adjacency.clear(b);
+
+			for (size_t d = 0; d < 3; d++)
+				position(a)[d] = target[d];
+
+			quadrics[a] += quadrics[b];
+
+			// every edge of a is tried again after this
+			flags[a] = (flags[a] | flags[b]) & ~REJECTED;
+
+			for (size_t i = 0; i < edgesA.size(); i++)
+				costs[edgesA[i]] = stale;
+
+			// give previously rejected edges around the new fan another chance
+			for (size_t i = 0; i < edgesA.size(); i++)
+			{
+				size_t x = other(edgesA[i], a);
+				if (!(flags[x] & REJECTED))
+					continue;
+
+				flags[x] &= ~REJECTED;
+				for (const index_t *r = adjacency.begin(EDGES, x); r != adjacency.end(EDGES, x); r++)
+					if (costs[*r] == rejected)
+						costs[*r] = stale;
+			}
+		}
+
+		void compactMesh()
+		{
+			const size_t unused = size_t(-1);
+			std::vector<size_t> remap(mesh.nVertices(), unused);
+			std::vector<double> vertices;
+			std::vector<size_t> compacted;
+			compacted.reserve(nAliveFaces * 3);
+
+			for (size_t f = 0; f < faces.size() / 3; f++)
+			{
+				if (!faceAlive(f))
+					continue;
+
+				for (size_t i = 0; i < 3; i++)
+				{
+					size_t v = faces[f * 3 + i];
+					if (remap[v] == unused)
+					{
+						remap[v] = vertices.size() / 3;
+						vertices.insert(vertices.end(), position(v), position(v) + 3);
+					}
+					compacted.push_back(remap[v]);
+				}
+			}
+
+			mesh.vertices.swap(vertices);
+			mesh.faces.swap(compacted);
+		}
+	};
+}
+
+
+size_t decimateMesh(TriangleMesh& mesh, size_t targetFaces, double maxError)
+{
+	if (mesh.nFaces() <= targetFaces)
+		return 0;
+
+	Decimator decimator(mesh);
+	return decimator.run(targetFaces, maxError);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Mesh.h"
+
+
+namespace constants
+{
+	const double decimationMinCosine = 0.2; // reject collapses that turn a face normal more than ~78 degrees
+	const double boundaryPenalty = 100.0; // weight of the planes that hold open boundaries in place
+	const double decimationPassShare = 1.0; // share of the remaining collapses each sweep of the edges aims for
+	const size_t decimationSamples = 16384; // edge costs sampled to place the threshold of a sweep
+}
+
+
+/*
+	decimateMesh
+
+		Garland-Heckbert edge collapse simplification.
+
+		Every vertex carries the quadric of its
+		area weighted face planes (plus perpendicular
+		planes along open boundaries), and every edge
+		the cost of collapsing it to the point that
+		minimizes the summed quadric. Instead of a
+		heap, the edges are swept in mesh order under
+		a cost threshold that rises every pass, each
+		pass aiming for a share of the collapses still
+		needed; the costs around a collapse are
+		recomputed when the sweep next needs them.
+
+		Collapses that would flip a face, break the
+		link condition or pinch two boundaries together
+		are rejected until their neighborhood changes.
+
+		Stops once the mesh has at most targetFaces
+		faces or no collapse costs at most
+		maxError (squared distance units, 0 for no
+		bound). Returns the number of collapses done;
+		the mesh is compacted afterwards.
+*/
+
+size_t decimateMesh(TriangleMesh& mesh, size_t targetFaces, double maxError = 0);
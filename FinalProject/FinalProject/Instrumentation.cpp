@@ -0,0 +1,298 @@
+#include "Instrumentation.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <cstdio>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+
+ProcessUsage processUsage()
+{
+	ProcessUsage usage;
+
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+
+	// FILETIME counts 100 ns ticks
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+	usage.cpuSeconds = (k.QuadPart + u.QuadPart) * 1e-7;
+
+	PROCESS_MEMORY_COUNTERS memory;
+	GetProcessMemoryInfo(GetCurrentProcess(), &memory, sizeof(memory));
+	usage.rssBytes = memory.WorkingSetSize;
+	usage.peakRssBytes = memory.PeakWorkingSetSize;
+#else
+	struct rusage self;
+	getrusage(RUSAGE_SELF, &self);
+	usage.cpuSeconds = self.ru_utime.tv_sec + self.ru_stime.tv_sec
+		+ (self.ru_utime.tv_usec + self.ru_stime.tv_usec) * 1e-6;
+
+#ifdef __APPLE__
+	usage.peakRssBytes = size_t(self.ru_maxrss);
+#else
+	usage.peakRssBytes = size_t(self.ru_maxrss) * 1024;
+#endif
+
+	// resident pages are the second field of statm
+	usage.rssBytes = usage.peakRssBytes;
+	if (FILE *statm = std::fopen("/proc/self/statm", "r"))
+	{
+		unsigned long size, resident;
+		if (std::fscanf(statm, "%lu %lu", &size, &resident) == 2)
+			usage.rssBytes = size_t(resident) * size_t(sysconf(_SC_PAGESIZE));
+		std::fclose(statm);
+	}
+#endif
+
+	return usage;
+}
+
+
+void StageProfiler::begin(const std::string& name)
+{
+	if (running)
+		end();
+
+	StageRecord record;
+	record.name = name;
+	record.wallSeconds = record.cpuSeconds = 0;
+	record.rssDelta = record.peakRssDelta = 0;
+	record.peakRssBytes = 0;
+	records.push_back(record);
+
+	running = true;
+	if (trace)
+		traceBegin = trace->now();
+	startUsage = processUsage();
+	startTime = std::chrono::steady_clock::now();
+}
+
+
+void StageProfiler::end()
+{
+	if (!running)
+		return;
+
+	std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
+	ProcessUsage endUsage = processUsage();
+
+	StageRecord& record = records.back();
+	record.wallSeconds = std::chrono::duration<double>(endTime - startTime).count();
+	record.cpuSeconds = endUsage.cpuSeconds - startUsage.cpuSeconds;
+	record.rssDelta = (long long)endUsage.rssBytes - (long long)startUsage.rssBytes;
+	record.peakRssDelta = (long long)endUsage.peakRssBytes - (long long)startUsage.peakRssBytes;
+	record.peakRssBytes = endUsage.peakRssBytes;
+
+	if (trace)
+		trace->span(record.name, "stage", 0, traceBegin, trace->now(), record.counters);
+
+	running = false;
+}
+
+
+void StageProfiler::count(const std::string& counter, size_t value)
+{
+	if (!running)
+		return;
+
+	std::vector<std::pair<std::string, size_t> >& counters = records.back().counters;
+	for (size_t c = 0; c < counters.size(); c++)
+		if (counters[c].first == counter)
+		{
+			counters[c].second = value;
+			return;
+		}
+
+	counters.push_back(std::make_pair(counter, value));
+}
+
+
+namespace
+{
+	const double megabyte = 1024.0 * 1024.0;
+
+	StageRecord total(const std::vector<StageRecord>& records)
+	{
+		StageRecord sum;
+		sum.name = "total";
+		sum.wallSeconds = sum.cpuSeconds = 0;
+		sum.rssDelta = sum.peakRssDelta = 0;
+		sum.peakRssBytes = 0;
+
+		for (size_t s = 0; s < records.size(); s++)
+		{
+			sum.wallSeconds += records[s].wallSeconds;
+			sum.cpuSeconds += records[s].cpuSeconds;
+			sum.rssDelta += records[s].rssDelta;
+			sum.peakRssDelta += records[s].peakRssDelta;
+			sum.peakRssBytes = std::max(sum.peakRssBytes, records[s].peakRssBytes);
+		}
+
+		return sum;
+	}
+
+	void printRow(std::ostream& out, const StageRecord& record, size_t nameWidth)
+	{
+		std::ostringstream counters;
+		for (size_t c = 0; c < record.counters.size(); c++)
+			counters << (c ? ", " : "") << record.counters[c].first << "=" << record.counters[c].second;
+
+		out << std::left << std::setw(nameWidth) << record.name << std::right
+			<< std::fixed << std::setprecision(1)
+			<< std::setw(12) << record.wallSeconds * 1e3
+			<< std::setw(12) << record.cpuSeconds * 1e3
+			<< std::setw(12) << record.rssDelta / megabyte
+			<< std::setw(12) << record.peakRssDelta / megabyte
+			<< "  " << counters.str() << std::endl;
+	}
+
+	// stage and counter names are ours, only quotes and backslashes need escaping
+	std::string jsonString(const std::string& s)
+	{
+		std::string escaped = "\"";
+		for (size_t i = 0; i < s.size(); i++)
+		{
+			if (s[i] == '"' || s[i] == '\\')
+				escaped += '\\';
+			escaped += s[i];
+		}
+		return escaped + "\"";
+	}
+
+	void writeJsonRecord(std::ostream& out, const StageRecord& record)
+	{
+		out << "{\"name\": " << jsonString(record.name)
+			<< ", \"wall_s\": " << record.wallSeconds
+			<< ", \"cpu_s\": " << record.cpuSeconds
+			<< ", \"rss_delta_bytes\": " << record.rssDelta
+			<< ", \"peak_rss_delta_bytes\": " << record.peakRssDelta
+			<< ", \"peak_rss_bytes\": " << record.peakRssBytes
+			<< ", \"counters\": {";
+
+		for (size_t c = 0; c < record.counters.size(); c++)
+			out << (c ? ", " : "") << jsonString(record.counters[c].first) << ": " << record.counters[c].second;
+
+		out << "}}";
+	}
+}
+
+
+void StageProfiler::printSummary(std::ostream& out) const
+{
+	size_t nameWidth = 8;
+	for (size_t s = 0; s < records.size(); s++)
+		nameWidth = std::max(nameWidth, records[s].name.size() + 2);
+
+	std::ios::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+
+	out << std::left << std::setw(nameWidth) << "stage" << std::right
+		<< std::setw(12) << "wall ms"
+		<< std::setw(12) << "cpu ms"
+		<< std::setw(12) << "rss MB"
+		<< std::setw(12) << "peak MB"
+		<< "  counters" << std::endl;
+	out << std::string(nameWidth + 48 + 10, '-') << std::endl;
+
+	for (size_t s = 0; s < records.size(); s++)
+		printRow(out, records[s], nameWidth);
+
+	out << std::string(nameWidth + 48 + 10, '-') << std::endl;
+	printRow(out, total(records), nameWidth);
+
+	out.flags(flags);
+	out.precision(precision);
+}
+
+
+void StageProfiler::writeJson(std::ostream& out) const
+{
+	std::streamsize precision = out.precision(9);
+
+	out << "{\n\t\"stages\": [";
+	for (size_t s = 0; s < records.size(); s++)
+	{
+		out << (s ? ",\n\t\t" : "\n\t\t");
+		writeJsonRecord(out, records[s]);
+	}
+	out << "\n\t],\n\t\"total\": ";
+	writeJsonRecord(out, total(records));
+	out << "\n}\n";
+
+	out.precision(precision);
+}
+
+
+void TraceRecorder::span(const std::string& name, const std::string& category, unsigned int tid, double beginUs, double endUs, const Args& args)
+{
+	Event event;
+	event.name = name;
+	event.category = category;
+	event.tid = tid;
+	event.beginUs = beginUs;
+	event.durationUs = endUs - beginUs;
+	event.args = args;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	events.push_back(event);
+}
+
+
+void TraceRecorder::writeJson(std::ostream& out) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::streamsize precision = out.precision(3);
+	std::ios::fmtflags flags = out.flags();
+	out << std::fixed;
+
+	out << "{\n\t\"traceEvents\": [";
+
+	// name the worker rows after their index
+	unsigned int nThreads = 0;
+	for (size_t e = 0; e < events.size(); e++)
+		nThreads = std::max(nThreads, events[e].tid + 1);
+
+	for (unsigned int tid = 0; tid < nThreads; tid++)
+		out << (tid ? ",\n\t\t" : "\n\t\t")
+			<< "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << tid
+			<< ", \"args\": {\"name\": \"" << (tid ? "worker " : "main ") << tid << "\"}}";
+
+	for (size_t e = 0; e < events.size(); e++)
+	{
+		const Event& event = events[e];
+		out << ",\n\t\t{\"name\": " << jsonString(event.name)
+			<< ", \"cat\": " << jsonString(event.category)
+			<< ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.tid
+			<< ", \"ts\": " << event.beginUs
+			<< ", \"dur\": " << event.durationUs
+			<< ", \"args\": {";
+
+		for (size_t a = 0; a < event.args.size(); a++)
+			out << (a ? ", " : "") << jsonString(event.args[a].first) << ": " << event.args[a].second;
+
+		out << "}}";
+	}
+
+	out << "\n\t],\n\t\"displayTimeUnit\": \"ms\"\n}\n";
+
+	out.flags(flags);
+	out.precision(precision);
+}
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+/*
+	ProcessUsage
+
+		Snapshot of the resources used by the
+		process so far: CPU time of all its threads,
+		and its current and peak resident set size.
+*/
+
+struct ProcessUsage
+{
+	double cpuSeconds;
+	size_t rssBytes;
+	size_t peakRssBytes;
+};
+
+ProcessUsage processUsage();
+
+
+/*
+	TraceRecorder
+
+		Collects complete ("X") events in the Chrome
+		trace-event format, to be opened in
+		chrome://tracing or Perfetto. Timestamps are
+		microseconds since the recorder was created
+		and tid is the parallelFor worker index, the
+		calling thread being worker 0.
+
+		Spans can be recorded from any thread.
+*/
+
+class TraceRecorder
+{
+public:
+	typedef std::vector<std::pair<std::string, size_t> > Args;
+
+	TraceRecorder() : origin(std::chrono::steady_clock::now()) {}
+
+	// microseconds since the recorder was created
+	double now() const { return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count(); }
+
+	void span(const std::string& name, const std::string& category, unsigned int tid, double beginUs, double endUs, const Args& args = Args());
+
+	// {"traceEvents": [...], "displayTimeUnit": "ms"}
+	void writeJson(std::ostream& out) const;
+
+private:
+	struct Event
+	{
+		std::string name;
+		std::string category;
+		unsigned int tid;
+		double beginUs;
+		double durationUs;
+		Args args;
+	};
+
+	std::chrono::steady_clock::time_point origin;
+	mutable std::mutex mutex;
+	std::vector<Event> events;
+};
+
+
+/*
+	TraceSpan
+
+		Records a span for the lifetime of the
+		object. Does nothing without a recorder, so
+		tracing can be switched off by passing NULL.
+*/
+
+class TraceSpan
+{
+public:
+	TraceSpan(TraceRecorder *t, const std::string& n, const std::string& category, unsigned int tid = 0)
+		: trace(t), name(n), cat(category), thread(tid), begin(t ? t->now() : 0) {}
+
+	~TraceSpan()
+	{
+		if (trace)
+			trace->span(name, cat, thread, begin, trace->now(), args);
+	}
+
+	void arg(const std::string& key, size_t value) { args.push_back(std::make_pair(key, value)); }
+
+private:
+	TraceRecorder *trace;
+	std::string name, cat;
+	unsigned int thread;
+	double begin;
+	TraceRecorder::Args args;
+
+	TraceSpan(const TraceSpan&);
+	TraceSpan& operator=(const TraceSpan&);
+};
+
+
+/*
+	StageRecord
+
+		Resources spent in one pipeline stage, plus
+		the item counts it reported (points,
+		neighbors, edges, ...).
+*/
+
+struct StageRecord
+{
+	std::string name;
+	double wallSeconds;
+	double cpuSeconds;
+	long long rssDelta;			// bytes, may be negative when the stage frees memory
+	long long peakRssDelta;		// growth of the high-water mark during the stage
+	size_t peakRssBytes;		// high-water mark at the end of the stage
+	std::vector<std::pair<std::string, size_t> > counters;
+};
+
+
+/*
+	StageProfiler
+
+		Records the stages of a run one after the
+		other. begin() closes the running stage, if
+		any, so the main pipeline can just mark
+		where every stage starts; counters are
+		attached to the running stage.
+
+		With a trace attached every stage is also
+		recorded as a span on the calling thread,
+		with its counters as arguments.
+
+		No global state, every run owns its
+		profiler.
+*/
+
+class StageProfiler
+{
+public:
+	StageProfiler() : running(false), trace(NULL), traceBegin(0) {}
+
+	void attachTrace(TraceRecorder *recorder) { trace = recorder; }
+
+	void begin(const std::string& name);
+	void end();
+	void count(const std::string& counter, size_t value);
+
+	const std::vector<StageRecord>& stages() const { return records; }
+
+	// aligned table, one row per stage plus the total
+	void printSummary(std::ostream& out) const;
+
+	// {"stages": [{"name", "wall_s", "cpu_s", ...}], "total": {...}}
+	void writeJson(std::ostream& out) const;
+
+private:
+	bool running;
+	std::chrono::steady_clock::time_point startTime;
+	ProcessUsage startUsage;
+	std::vector<StageRecord> records;
+
+	TraceRecorder *trace;
+	double traceBegin;
+};
+
+
+/*
+	ScopedStage
+
+		Runs a stage for the lifetime of the
+		object.
+*/
+
+class ScopedStage
+{
+public:
+	ScopedStage(StageProfiler& p, const std::string& name) : profiler(p) { profiler.begin(name); }
+	~ScopedStage() { profiler.end(); }
+
+	void count(const std::string& counter, size_t value) { profiler.count(counter, value); }
+
+private:
+	StageProfiler& profiler;
+
+	ScopedStage(const ScopedStage&);
+	ScopedStage& operator=(const ScopedStage&);
+};
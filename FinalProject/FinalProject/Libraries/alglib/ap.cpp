@@ -736,12 +736,33 @@ void memory_pool_stats(ae_int_t *bytes_used, ae_int_t *bytes_free)
 }
 #endif
 
+/************************************************************************
+Allocator of the current thread, NULL for the heap. Blocks of aligned_malloc()
+store their allocator and the start of the underlying block in the two
+pointers just before the aligned address.
+************************************************************************/
+static thread_local ae_allocator *_thread_allocator = NULL;
+
+void ae_set_thread_allocator(ae_allocator *allocator)
+{
+    _thread_allocator = allocator;
+}
+
+ae_allocator* ae_get_thread_allocator()
+{
+    return _thread_allocator;
+}
+
 void* aligned_malloc(size_t size, size_t alignment)
 {
 #if AE_MALLOC==AE_BASIC_STATIC_MALLOC
     return ae_static_malloc(size, alignment);
 #else
     char *result = NULL;
+    void *block = NULL;
+    size_t header = 2*sizeof(void*);
+    size_t total;
+    ae_allocator *allocator;
     
     if( size==0 )
         return NULL;
@@ -750,32 +771,25 @@ void* aligned_malloc(size_t size, size_t alignment)
     if( _malloc_failure_after>0 && _alloc_counter_total>=_malloc_failure_after )
         return NULL;
     
-    /* allocate */
-    if( alignment<=1 )
+    /* allocate, from the thread allocator if any and it has room */
+    total = (alignment>1 ? alignment-1 : 0)+header+size;
+    allocator = _thread_allocator;
+    if( allocator!=NULL )
+        block = allocator->allocate(allocator->context, total);
+    if( block==NULL )
     {
-        /* no alignment, just call alloc */
-        void *block;
-        void **p; ;
-        block = malloc(sizeof(void*)+size);
+        allocator = NULL;
+        block = malloc(total);
         if( block==NULL )
             return NULL;
-        p = (void**)block;
-        *p = block;
-        result = (char*)((char*)block+sizeof(void*));
     }
-    else
-    {
-        /* align */
-        void *block;
-        block = malloc(alignment-1+sizeof(void*)+size);
-        if( block==NULL )
-            return NULL;
-        result = (char*)block+sizeof(void*);
-        /*if( (result-(char*)0)%alignment!=0 )
-            result += alignment - (result-(char*)0)%alignment;*/
+    
+    /* align and fill the header */
+    result = (char*)block+header;
+    if( alignment>1 )
         result = (char*)ae_align(result, alignment);
-        *((void**)(result-sizeof(void*))) = block;
-    }
+    *((void**)(result-sizeof(void*))) = block;
+    *((ae_allocator**)(result-2*sizeof(void*))) = allocator;
     
     /* update counters (if flag is set) */
     if( _use_alloc_counter )
@@ -797,10 +811,15 @@ void aligned_free(void *block)
     ae_static_free(block);
 #else
     void *p;
+    ae_allocator *allocator;
     if( block==NULL )
         return;
     p = *((void**)((char*)block-sizeof(void*)));
-    free(p);
+    allocator = *((ae_allocator**)((char*)block-2*sizeof(void*)));
+    if( allocator!=NULL )
+        allocator->release(allocator->context, p);
+    else
+        free(p);
     if( _use_alloc_counter )
         ae_optional_atomic_sub_i(&_alloc_counter, 1);
 #endif
@@ -710,6 +710,24 @@ ae_int_t ae_get_effective_workers(ae_int_t nworkers);
 void  ae_optional_atomic_add_i(ae_int_t *p, ae_int_t v);
 void  ae_optional_atomic_sub_i(ae_int_t *p, ae_int_t v);
 
+/************************************************************************
+Thread allocator: while installed on a thread, aligned_malloc() takes the
+blocks of that thread from it instead of the heap (eternal_malloc() is not
+affected). allocate() may return NULL, the heap is used then. Every block
+remembers where it came from, so it is freed correctly whatever allocator
+is installed at the time, but it must be freed by the thread which
+allocated it, and the allocator must stay valid until then.
+************************************************************************/
+typedef struct
+{
+    void* (*allocate)(void *context, size_t size);
+    void  (*release)(void *context, void *block);
+    void  *context;
+} ae_allocator;
+
+void ae_set_thread_allocator(ae_allocator *allocator);
+ae_allocator* ae_get_thread_allocator();
+
 void* aligned_malloc(size_t size, size_t alignment);
 void  aligned_free(void *block);
 void* eternal_malloc(size_t size);
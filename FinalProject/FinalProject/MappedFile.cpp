@@ -0,0 +1,126 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() : bytes(NULL), length(0), opened(false), file(INVALID_HANDLE_VALUE), mapping(NULL) {}
+
+bool MappedFile::open(const std::string& filename)
+{
+	close();
+
+	file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize))
+	{
+		close();
+		return false;
+	}
+	length = size_t(fileSize.QuadPart);
+
+	// a zero length file can't be mapped
+	if (length > 0)
+	{
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping)
+			bytes = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (!bytes)
+		{
+			close();
+			return false;
+		}
+	}
+
+	opened = true;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (bytes)
+		UnmapViewOfFile(bytes);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+
+	bytes = NULL;
+	length = 0;
+	opened = false;
+	file = INVALID_HANDLE_VALUE;
+	mapping = NULL;
+}
+
+#else
+
+MappedFile::MappedFile() : bytes(NULL), length(0), opened(false) {}
+
+bool MappedFile::open(const std::string& filename)
+{
+	close();
+
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat status;
+	if (fstat(fd, &status) != 0)
+	{
+		::close(fd);
+		return false;
+	}
+	length = size_t(status.st_size);
+
+	// a zero length file can't be mapped
+	if (length > 0)
+	{
+		void *address = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (address == MAP_FAILED)
+		{
+			::close(fd);
+			length = 0;
+			return false;
+		}
+
+		// decoded front to back
+		madvise(address, length, MADV_SEQUENTIAL);
+		bytes = static_cast<const char*>(address);
+	}
+
+	// the mapping holds its own reference to the file
+	::close(fd);
+	opened = true;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (bytes)
+		munmap(const_cast<char*>(bytes), length);
+
+	bytes = NULL;
+	length = 0;
+	opened = false;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+
+
+/*
+	MappedFile
+
+		A whole file mapped read only into memory,
+		so binary inputs can be decoded in place
+		instead of being read through a stream into
+		an intermediate buffer. The mapping lives
+		until close() or the destructor, pointers
+		into data() are only valid until then.
+
+		Empty files open with a NULL data().
+*/
+
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const std::string& filename);
+	void close();
+
+	bool isOpen() const { return opened; }
+	const char *data() const { return bytes; }
+	size_t size() const { return length; }
+
+private:
+	const char *bytes;
+	size_t length;
+	bool opened;
+
+#ifdef _WIN32
+	void *file;
+	void *mapping;
+#endif
+
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+};
@@ -0,0 +1,64 @@
+#include "Mesh.h"
+
+#include <algorithm>
+#include <fstream>
+#include <utility>
+
+
+std::vector<size_t> meshEdges(const TriangleMesh& mesh)
+{
+	std::vector<std::pair<size_t, size_t>> pairs;
+	pairs.reserve(mesh.faces.size());
+
+	for (size_t f = 0; f < mesh.nFaces(); f++)
+	{
+		const size_t *face = &mesh.faces[f * 3];
+		for (size_t e = 0; e < 3; e++)
+		{
+			size_t a = face[e], b = face[(e + 1) % 3];
+			pairs.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+		}
+	}
+
+	// interior edges are shared by two faces
+	std::sort(pairs.begin(), pairs.end());
+	pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+	std::vector<size_t> edges;
+	edges.reserve(pairs.size() * 2);
+	for (size_t e = 0; e < pairs.size(); e++)
+	{
+		edges.push_back(pairs[e].first);
+		edges.push_back(pairs[e].second);
+	}
+
+	return edges;
+}
+
+
+bool saveMesh(const TriangleMesh& mesh, const std::string& filename)
+{
+	std::ofstream out(filename);
+	if (!out)
+		return false;
+
+	// enough digits to round-trip the float input
+	out.precision(9);
+
+	out << "# " << mesh.nVertices() << " vertices, " << mesh.nFaces() << " faces" << std::endl;
+
+	for (size_t v = 0; v < mesh.nVertices(); v++)
+	{
+		const double *p = &mesh.vertices[v * 3];
+		out << "v " << p[0] << " " << p[1] << " " << p[2] << "\n";
+	}
+
+	// OBJ indices are 1-based
+	for (size_t f = 0; f < mesh.nFaces(); f++)
+	{
+		const size_t *face = &mesh.faces[f * 3];
+		out << "f " << face[0] + 1 << " " << face[1] + 1 << " " << face[2] + 1 << "\n";
+	}
+
+	return bool(out);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+/*
+	TriangleMesh
+
+		Indexed triangle mesh. Vertices are stored
+		interleaved (x, y, z, x, y, z, ...) like
+		tinyobj's attrib.vertices, and faces as
+		consecutive vertex index triples.
+*/
+
+struct TriangleMesh
+{
+	std::vector<double> vertices;
+	std::vector<size_t> faces;
+
+	size_t nVertices() const { return vertices.size() / 3; }
+	size_t nFaces() const { return faces.size() / 3; }
+};
+
+
+/*
+	meshEdges
+
+		Collects the unique undirected edges of
+		the mesh as (lo, hi) vertex index pairs,
+		stored interleaved and sorted.
+*/
+
+std::vector<size_t> meshEdges(const TriangleMesh& mesh);
+
+
+/*
+	saveMesh
+
+		Writes the mesh as a wavefront OBJ file.
+*/
+
+bool saveMesh(const TriangleMesh& mesh, const std::string& filename);
@@ -0,0 +1,323 @@
+#include "MeshOptimization.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+#include "Libraries/alglib/alglibmisc.h"
+#include "Libraries/alglib/solvers.h"
+
+#include "Parallel.h"
+
+
+namespace
+{
+	inline double dot(const double *a, const double *b)
+	{
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	/*
+		closestPointOnTriangle
+
+			Ericson's region test (Real-Time Collision
+			Detection, 5.1.5). Writes the barycentric
+			coordinates of the closest point of triangle
+			(a, b, c) to p, returns the squared distance.
+	*/
+
+	double closestPointOnTriangle(const double *p, const double *a, const double *b, const double *c, double *bary)
+	{
+		double ab[3], ac[3], ap[3];
+		for (size_t d = 0; d < 3; d++)
+		{
+			ab[d] = b[d] - a[d];
+			ac[d] = c[d] - a[d];
+			ap[d] = p[d] - a[d];
+		}
+
+		double d1 = dot(ab, ap), d2 = dot(ac, ap);
+		if (d1 <= 0 && d2 <= 0)
+		{
+			bary[0] = 1; bary[1] = 0; bary[2] = 0;
+		}
+		else
+		{
+			double bp[3], cp[3];
+			for (size_t d = 0; d < 3; d++)
+			{
+				bp[d] = p[d] - b[d];
+				cp[d] = p[d] - c[d];
+			}
+
+			double d3 = dot(ab, bp), d4 = dot(ac, bp);
+			double d5 = dot(ab, cp), d6 = dot(ac, cp);
+			double vc = d1 * d4 - d3 * d2;
+			double vb = d5 * d2 - d1 * d6;
+			double va = d3 * d6 - d5 * d4;
+
+			if (d3 >= 0 && d4 <= d3)
+			{
+				bary[0] = 0; bary[1] = 1; bary[2] = 0;
+			}
+			else if (vc <= 0 && d1 >= 0 && d3 <= 0)
+			{
+				double v = d1 / (d1 - d3);
+				bary[0] = 1 - v; bary[1] = v; bary[2] = 0;
+			}
+			else if (d6 >= 0 && d5 <= d6)
+			{
+				bary[0] = 0; bary[1] = 0; bary[2] = 1;
+			}
+			else if (vb <= 0 && d2 >= 0 && d6 <= 0)
+			{
+				double w = d2 / (d2 - d6);
+				bary[0] = 1 - w; bary[1] = 0; bary[2] = w;
+			}
+			else if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0)
+			{
+				double w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+				bary[0] = 0; bary[1] = 1 - w; bary[2] = w;
+			}
+			else
+			{
+				double denom = 1 / (va + vb + vc);
+				bary[1] = vb * denom;
+				bary[2] = vc * denom;
+				bary[0] = 1 - bary[1] - bary[2];
+			}
+		}
+
+		double dist2 = 0;
+		for (size_t d = 0; d < 3; d++)
+		{
+			double q = bary[0] * a[d] + bary[1] * b[d] + bary[2] * c[d];
+			dist2 += (p[d] - q) * (p[d] - q);
+		}
+
+		return dist2;
+	}
+}
+
+
+void projectPoints(
+	const TriangleMesh& mesh,
+	const alglib::real_2d_array& points,
+	size_t nPoints,
+	MeshProjection& projection,
+	unsigned int nThreads)
+{
+	size_t nFaces = mesh.nFaces();
+
+	// kdtree of face centroids tagged with the face index
+	alglib::real_2d_array faceCentroids;
+	alglib::integer_1d_array faceTags;
+	faceCentroids.setlength(nFaces, 3);
+	faceTags.setlength(nFaces);
+
+	for (size_t f = 0; f < nFaces; f++)
+	{
+		for (size_t d = 0; d < 3; d++)
+		{
+			faceCentroids[f][d] = 0;
+			for (size_t i = 0; i < 3; i++)
+				faceCentroids[f][d] += mesh.vertices[mesh.faces[f * 3 + i] * 3 + d] / 3;
+		}
+		faceTags[f] = f;
+	}
+
+	alglib::kdtree kdtFaces;
+	alglib::kdtreebuildtagged(faceCentroids, faceTags, nFaces, 3, 0, 2, kdtFaces, alglibThreading(nThreads));
+
+	projection.faces.resize(nPoints);
+	projection.barycentric.resize(nPoints * 3);
+	projection.distances2.resize(nPoints);
+
+	alglib::ae_int_t k = std::min<alglib::ae_int_t>(constants::projectionCandidates, nFaces);
+
+	parallelFor(nPoints, [&](size_t begin, size_t end, unsigned int)
+	{
+		alglib::kdtreerequestbuffer buffer;
+		alglib::kdtreecreaterequestbuffer(kdtFaces, buffer);
+
+		alglib::real_1d_array query;
+		alglib::integer_1d_array candidates;
+		query.setlength(3);
+
+		for (size_t i = begin; i < end; i++)
+		{
+			const double *p = points[i];
+			for (size_t d = 0; d < 3; d++)
+				query[d] = p[d];
+
+			alglib::ae_int_t found = alglib::kdtreetsqueryknn(kdtFaces, buffer, query, k);
+			alglib::kdtreetsqueryresultstags(kdtFaces, buffer, candidates);
+
+			double best = std::numeric_limits<double>::max();
+			for (alglib::ae_int_t c = 0; c < found; c++)
+			{
+				size_t f = candidates[c];
+				const size_t *face = &mesh.faces[f * 3];
+
+				double bary[3];
+				double dist2 = closestPointOnTriangle(p,
+					&mesh.vertices[face[0] * 3],
+					&mesh.vertices[face[1] * 3],
+					&mesh.vertices[face[2] * 3],
+					bary);
+
+				if (dist2 < best)
+				{
+					best = dist2;
+					projection.faces[i] = f;
+					std::copy(bary, bary + 3, &projection.barycentric[i * 3]);
+					projection.distances2[i] = dist2;
+				}
+			}
+		}
+	}, nThreads);
+}
+
+
+alglib::ae_int_t solveSparseLeastSquares(const alglib::sparsematrix& a, const alglib::real_1d_array& b, alglib::real_1d_array& x, alglib::ae_int_t maxIterations)
+{
+	alglib::linlsqrstate state;
+	alglib::linlsqrreport report;
+
+	alglib::linlsqrcreate(alglib::sparsegetnrows(a), alglib::sparsegetncols(a), state);
+	alglib::linlsqrsetcond(state, 0.0, 0.0, maxIterations);
+	alglib::linlsqrsolvesparse(state, a, b);
+	alglib::linlsqrresults(state, x, report);
+
+	return report.iterationscount;
+}
+
+
+double distanceEnergy(const MeshProjection& projection)
+{
+	double energy = 0;
+	for (size_t i = 0; i < projection.distances2.size(); i++)
+		energy += projection.distances2[i];
+
+	return energy;
+}
+
+
+double springEnergy(const TriangleMesh& mesh, const std::vector<size_t>& edges, double springConstant)
+{
+	double energy = 0;
+	for (size_t e = 0; e < edges.size(); e += 2)
+	{
+		const double *a = &mesh.vertices[edges[e] * 3];
+		const double *b = &mesh.vertices[edges[e + 1] * 3];
+		for (size_t d = 0; d < 3; d++)
+			energy += (a[d] - b[d]) * (a[d] - b[d]);
+	}
+
+	return springConstant * energy;
+}
+
+
+void optimizeVertexPositions(
+	TriangleMesh& mesh,
+	const std::vector<size_t>& edges,
+	const alglib::real_2d_array& points,
+	size_t nPoints,
+	const MeshProjection& projection,
+	double springConstant)
+{
+	size_t nVertices = mesh.nVertices();
+	size_t nEdges = edges.size() / 2;
+	size_t nRows = nPoints + nEdges;
+	double spring = std::sqrt(springConstant);
+
+	// 3 entries per point row, 2 per edge row
+	alglib::integer_1d_array rowSizes;
+	rowSizes.setlength(nRows);
+	for (size_t r = 0; r < nRows; r++)
+		rowSizes[r] = r < nPoints ? 3 : 2;
+
+	alglib::sparsematrix a;
+	alglib::sparsecreatecrs(nRows, nVertices, rowSizes, a);
+
+	// CRS elements go in row order, left to right
+	for (size_t i = 0; i < nPoints; i++)
+	{
+		const size_t *face = &mesh.faces[projection.faces[i] * 3];
+		const double *bary = &projection.barycentric[i * 3];
+
+		size_t order[3] = { 0, 1, 2 };
+		std::sort(order, order + 3, [&](size_t l, size_t r) { return face[l] < face[r]; });
+
+		for (size_t j = 0; j < 3; j++)
+			alglib::sparseset(a, i, face[order[j]], bary[order[j]]);
+	}
+
+	for (size_t e = 0; e < nEdges; e++)
+	{
+		alglib::sparseset(a, nPoints + e, edges[e * 2], spring);
+		alglib::sparseset(a, nPoints + e, edges[e * 2 + 1], -spring);
+	}
+
+	alglib::real_1d_array b, x;
+	b.setlength(nRows);
+
+	for (size_t d = 0; d < 3; d++)
+	{
+		// residuals at the current positions, we solve for the displacement
+		for (size_t i = 0; i < nPoints; i++)
+		{
+			const size_t *face = &mesh.faces[projection.faces[i] * 3];
+			const double *bary = &projection.barycentric[i * 3];
+
+			double q = 0;
+			for (size_t j = 0; j < 3; j++)
+				q += bary[j] * mesh.vertices[face[j] * 3 + d];
+
+			b[i] = points[i][d] - q;
+		}
+
+		for (size_t e = 0; e < nEdges; e++)
+			b[nPoints + e] = -spring * (mesh.vertices[edges[e * 2] * 3 + d] - mesh.vertices[edges[e * 2 + 1] * 3 + d]);
+
+		solveSparseLeastSquares(a, b, x);
+
+		for (size_t v = 0; v < nVertices; v++)
+			mesh.vertices[v * 3 + d] += x[v];
+	}
+}
+
+
+double optimizeMesh(
+	TriangleMesh& mesh,
+	const alglib::real_2d_array& points,
+	size_t nPoints,
+	double springConstant,
+	unsigned int iterations,
+	unsigned int nThreads,
+	std::ostream *log)
+{
+	std::vector<size_t> edges = meshEdges(mesh);
+
+	MeshProjection projection;
+	projectPoints(mesh, points, nPoints, projection, nThreads);
+
+	double energy = distanceEnergy(projection) + springEnergy(mesh, edges, springConstant);
+
+	if (log)
+		*log << "Initial energy E_dist + E_spring = " << energy << std::endl;
+
+	for (unsigned int it = 0; it < iterations; it++)
+	{
+		optimizeVertexPositions(mesh, edges, points, nPoints, projection, springConstant);
+		projectPoints(mesh, points, nPoints, projection, nThreads);
+
+		energy = distanceEnergy(projection) + springEnergy(mesh, edges, springConstant);
+
+		if (log)
+			*log << "Iteration " << it << " energy E_dist + E_spring = " << energy << std::endl;
+	}
+
+	return energy;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <ostream>
+#include <vector>
+
+#include "Libraries/alglib/linalg.h"
+
+#include "Mesh.h"
+
+
+namespace constants
+{
+	const unsigned int projectionCandidates = 16; // faces tested per point when projecting onto the mesh
+	const unsigned int lsqrMaxIterations = 200; // LSQR iterations per coordinate solve
+}
+
+
+/*
+	MeshProjection
+
+		Closest point on the mesh of every input
+		point, as the face that contains it and its
+		barycentric coordinates on that face.
+*/
+
+struct MeshProjection
+{
+	std::vector<size_t> faces;
+	std::vector<double> barycentric; // 3 per point
+	std::vector<double> distances2;  // squared distance point to mesh
+};
+
+
+/*
+	projectPoints
+
+		Finds the closest point on the mesh of every
+		input point. Candidate faces are the ones with
+		the nearest centroids, taken from a kdtree of
+		face centroids; the exact point-triangle
+		distance picks the best of them.
+
+		Points are projected in parallel, every worker
+		with its own kdtree request buffer.
+*/
+
+void projectPoints(
+	const TriangleMesh& mesh,
+	const alglib::real_2d_array& points,
+	size_t nPoints,
+	MeshProjection& projection,
+	unsigned int nThreads = 0);
+
+
+/*
+	solveSparseLeastSquares
+
+		Minimizes ||A x - b|| for a CRS matrix A
+		with alglib's LSQR. Returns the number of
+		iterations taken.
+*/
+
+alglib::ae_int_t solveSparseLeastSquares(const alglib::sparsematrix& a, const alglib::real_1d_array& b, alglib::real_1d_array& x, alglib::ae_int_t maxIterations = constants::lsqrMaxIterations);
+
+
+/*
+	distanceEnergy
+
+		Hoppe's E_dist, the sum of squared distances
+		from the points to the mesh.
+*/
+
+double distanceEnergy(const MeshProjection& projection);
+
+
+/*
+	springEnergy
+
+		Hoppe's E_spring, kappa times the sum of
+		squared edge lengths.
+*/
+
+double springEnergy(const TriangleMesh& mesh, const std::vector<size_t>& edges, double springConstant);
+
+
+/*
+	optimizeVertexPositions
+
+		With the projections fixed, E_dist + E_spring
+		is quadratic in the vertex positions. Each
+		point contributes a row sum(b_j v_j) = x_i and
+		each edge a row sqrt(kappa) (v_j - v_k) = 0.
+		The three coordinates are solved independently
+		over the same sparse matrix, for the
+		displacement of the vertices from their current
+		position.
+*/
+
+void optimizeVertexPositions(
+	TriangleMesh& mesh,
+	const std::vector<size_t>& edges,
+	const alglib::real_2d_array& points,
+	size_t nPoints,
+	const MeshProjection& projection,
+	double springConstant);
+
+
+/*
+	optimizeMesh
+
+		Minimizes Hoppe's energy over the vertex
+		positions, alternating projections and linear
+		solves. The connectivity is left unchanged, so
+		E_rep stays constant and the mesh is never
+		densified. Returns E_dist + E_spring after the
+		last iteration, the energy of every iteration
+		is written to log if given.
+*/
+
+double optimizeMesh(
+	TriangleMesh& mesh,
+	const alglib::real_2d_array& points,
+	size_t nPoints,
+	double springConstant,
+	unsigned int iterations,
+	unsigned int nThreads = 0,
+	std::ostream *log = NULL);
@@ -0,0 +1,625 @@
+#include "NormalEstimation.h"
+
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include <queue>
+#include <vector>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// alglib principal component analysis
+#include "Libraries/alglib/dataanalysis.h"
+
+#include "AlglibArena.h"
+#include "Parallel.h"
+#include "PointCloud.h"
+
+
+alglib::real_1d_array calculateCentroid(const alglib::real_2d_array& points, alglib::ae_int_t k)
+{
+	// the centroid is the mean vector of the neighbors
+	alglib::real_1d_array centroid;
+	centroid.setlength(constants::dims);
+	
+	// initialize
+	for (size_t d = 0; d < constants::dims; d++)
+		centroid[d] = 0;
+	
+	// sum mean vector
+	for (alglib::ae_int_t i = 0; i < k; i++)
+		for (size_t d = 0; d < constants::dims; d++)
+			centroid[d] += points[i][d];
+
+	// mean
+	for (size_t d = 0; d < constants::dims; d++)
+		centroid[d] /= k;
+
+	return centroid;
+}
+
+alglib::real_1d_array calculateNormal(const alglib::real_2d_array& points, alglib::ae_int_t k)
+{
+	// will store normal estimation to return
+	alglib::real_1d_array normal;
+	
+	// pcaInfo returns 1 if valid
+	alglib::ae_int_t pcaInfo;
+	
+	// pcaS2 -> eigenvalues in descending order
+	// pcaV  -> eigenvectors in corresponding order
+	alglib::real_1d_array pcaS2;
+	alglib::real_2d_array pcaV;
+
+	// perform full pca on the points
+	alglib::pcabuildbasis(points, k, constants::dims, pcaInfo, pcaS2, pcaV);
+	
+	// set normal to last eigenvector, the basis vectors are the columns of pcaV
+	normal.setlength(constants::dims);
+	for (size_t d = 0; d < constants::dims; d++)
+		normal[d] = pcaV[d][constants::dims-1];
+
+	return normal;
+}
+
+
+namespace
+{
+	// eigenvector of the least eigenvalue of the symmetric matrix a, by cyclic Jacobi rotations, a is destroyed;
+	// false if the two least are both zero, leaving the plane undetermined
+	bool leastEigenvector(double a[3][3], double *vector)
+	{
+		double v[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+		const int pairs[3][2] = { { 0, 1 }, { 0, 2 }, { 1, 2 } };
+
+		for (int sweep = 0; sweep < 50; sweep++)
+		{
+			double off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+			double diagonal = a[0][0] * a[0][0] + a[1][1] * a[1][1] + a[2][2] * a[2][2];
+			if (off <= DBL_EPSILON * DBL_EPSILON * diagonal)
+				break;
+
+			for (int r = 0; r < 3; r++)
+			{
+				int p = pairs[r][0], q = pairs[r][1];
+				if (a[p][q] == 0)
+					continue;
+
+				// the rotation zeroing a[p][q]
+				double theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+				double t = (theta >= 0 ? 1.0 : -1.0) / (std::fabs(theta) + std::sqrt(theta * theta + 1));
+				double c = 1 / std::sqrt(t * t + 1), s = t * c;
+
+				for (int k = 0; k < 3; k++)
+				{
+					double akp = a[k][p], akq = a[k][q];
+					a[k][p] = c * akp - s * akq;
+					a[k][q] = s * akp + c * akq;
+				}
+				for (int k = 0; k < 3; k++)
+				{
+					double apk = a[p][k], aqk = a[q][k];
+					a[p][k] = c * apk - s * aqk;
+					a[q][k] = s * apk + c * aqk;
+				}
+				for (int k = 0; k < 3; k++)
+				{
+					double vkp = v[k][p], vkq = v[k][q];
+					v[k][p] = c * vkp - s * vkq;
+					v[k][q] = s * vkp + c * vkq;
+				}
+			}
+		}
+
+		int least = 0, most = 0;
+		for (int d = 1; d < 3; d++)
+		{
+			if (a[d][d] < a[least][least])
+				least = d;
+			if (a[d][d] > a[most][most])
+				most = d;
+		}
+		int middle = 3 - least - most;
+		if (least == most || a[middle][middle] <= 1e-12 * a[most][most])
+			return false;
+
+		double norm = std::sqrt(v[0][least] * v[0][least] + v[1][least] * v[1][least] + v[2][least] * v[2][least]);
+		for (int d = 0; d < 3; d++)
+			vector[d] = v[d][least] / norm;
+		return true;
+	}
+}
+
+
+PlaneScratch::PlaneScratch(const alglib::kdtree& kdt)
+{
+	alglib::kdtreecreaterequestbuffer(kdt, buffer);
+	queryPoint.setlength(constants::dims);
+}
+
+
+alglib::ae_int_t fitPlane(const alglib::kdtree& kdt, PlaneScratch& scratch, const double *point, double radius,
+	double *centroid, double *normal)
+{
+	for (size_t d = 0; d < constants::dims; d++)
+		scratch.queryPoint[d] = point[d];
+
+	// the results only reallocate the neighbors when they don't fit
+	alglib::ae_int_t k = alglib::kdtreetsqueryrnn(kdt, scratch.buffer, scratch.queryPoint, radius);
+	alglib::kdtreetsqueryresultsx(kdt, scratch.buffer, scratch.neighbors);
+
+	double mean[3] = { 0, 0, 0 };
+	for (alglib::ae_int_t i = 0; i < k; i++)
+		for (size_t d = 0; d < 3; d++)
+			mean[d] += scratch.neighbors[i][d];
+	for (size_t d = 0; d < 3; d++)
+		mean[d] = k > 0 ? mean[d] / k : point[d];
+
+	// covariance about the centroid, its scale doesn't matter
+	double covariance[3][3] = { { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 } };
+	for (alglib::ae_int_t i = 0; i < k; i++)
+	{
+		double x[3];
+		for (size_t d = 0; d < 3; d++)
+			x[d] = scratch.neighbors[i][d] - mean[d];
+		for (size_t r = 0; r < 3; r++)
+			for (size_t c = r; c < 3; c++)
+				covariance[r][c] += x[r] * x[c];
+	}
+	for (size_t r = 0; r < 3; r++)
+		for (size_t c = 0; c < r; c++)
+			covariance[r][c] = covariance[c][r];
+
+	// fewer than 3 points, or on a line: any normal fits, keep the one the PCA picks
+	if (!leastEigenvector(covariance, normal))
+	{
+		alglib::real_1d_array pcaNormal = calculateNormal(scratch.neighbors, k);
+		for (size_t d = 0; d < 3; d++)
+			normal[d] = pcaNormal[d];
+	}
+
+	for (size_t d = 0; d < 3; d++)
+		centroid[d] = mean[d];
+
+	return k;
+}
+
+
+size_t estimatePlanes(
+	const alglib::kdtree& kdt,
+	const alglib::real_2d_array& points,
+	size_t nPoints,
+	double radius,
+	Vec3Arrays& centroids,
+	Vec3Arrays& normals,
+	unsigned int nThreads,
+	TraceRecorder *trace,
+	std::ostream *log)
+{
+	// indexed normals
+	normals.resize(nPoints);
+
+	// indexed centroids
+	centroids.resize(nPoints);
+
+	if (log)
+		nThreads = 1;	// keep the point dumps in order
+
+	// neighbors seen by every worker
+	std::vector<size_t> workerNeighbors(workerCount(nThreads), 0);
+
+	// for every point, in contiguous chunks per worker
+	parallelFor(nPoints, [&](size_t begin, size_t end, unsigned int worker)
+	{
+		TraceSpan span(trace, "planes chunk", "worker", worker);
+		span.arg("points", end - begin);
+
+		// kdtree results and PCA fallbacks
+		AlglibArena arena;
+		AlglibArenaScope scope(arena);
+
+		PlaneScratch scratch(kdt);
+
+		size_t chunkNeighbors = 0;
+		for (size_t i = begin; i < end; i++)
+		{
+			double centroid[3], normal[3];
+			alglib::ae_int_t k = fitPlane(kdt, scratch, points[i], radius, centroid, normal);
+			centroids.set(i, centroid);
+			normals.set(i, normal);
+			chunkNeighbors += k;
+
+			if (log)
+			{
+				alglib::real_2d_array neighbors;
+				neighbors.setlength(k, constants::dims);
+				for (alglib::ae_int_t j = 0; j < k; j++)
+					for (size_t d = 0; d < constants::dims; d++)
+						neighbors[j][d] = scratch.neighbors[j][d];
+
+				alglib::real_1d_array logCentroid, logNormal;
+				logCentroid.setcontent(constants::dims, centroid);
+				logNormal.setcontent(constants::dims, normal);
+
+				*log << "\nPOINT " << i << " : " << std::endl;
+				*log << "For query point " << scratch.queryPoint.tostring(constants::psd) << " with radius " << radius << std::endl;
+				*log << "The neighborhood is the set " << neighbors.tostring(constants::psd) << std::endl;
+				*log << "The centroid is " << logCentroid.tostring(constants::psd) << std::endl;
+				*log << "And the normal is " << logNormal.tostring(constants::psd) << std::endl << std::endl;
+			}
+		}
+
+		workerNeighbors[worker] = chunkNeighbors;
+	}, nThreads);
+
+	size_t totalNeighbors = 0;
+	for (size_t w = 0; w < workerNeighbors.size(); w++)
+		totalNeighbors += workerNeighbors[w];
+
+	return totalNeighbors;
+}
+
+
+double RiemannianGraph::weight(size_t u, size_t v) const
+{
+	// the rows are sorted
+	const size_t *begin = targets.data() + offsets[u];
+	const size_t *end = targets.data() + offsets[u + 1];
+	const size_t *found = std::lower_bound(begin, end, v);
+
+	if (found == end || *found != v)
+		return DBL_MAX;
+	return weights[found - targets.data()];
+}
+
+
+void RiemannianGraph::clear()
+{
+	offsets.clear();
+	targets.clear();
+	weights.clear();
+}
+
+
+void assembleGraph(std::vector<GraphEdge>& edges, size_t nVertices, RiemannianGraph& graph)
+{
+	// u < v, sorted, and the two visits of every edge merged
+	for (size_t e = 0; e < edges.size(); e++)
+		if (edges[e].v < edges[e].u)
+			std::swap(edges[e].u, edges[e].v);
+
+	std::sort(edges.begin(), edges.end(), [](const GraphEdge& a, const GraphEdge& b)
+	{
+		return a.u < b.u || (a.u == b.u && a.v < b.v);
+	});
+	edges.erase(std::unique(edges.begin(), edges.end(), [](const GraphEdge& a, const GraphEdge& b)
+	{
+		return a.u == b.u && a.v == b.v;
+	}), edges.end());
+
+	// rows, both directions
+	graph.offsets.assign(nVertices + 1, 0);
+	for (size_t e = 0; e < edges.size(); e++)
+	{
+		graph.offsets[edges[e].u + 1]++;
+		graph.offsets[edges[e].v + 1]++;
+	}
+	for (size_t u = 0; u < nVertices; u++)
+		graph.offsets[u + 1] += graph.offsets[u];
+
+	graph.targets.resize(2 * edges.size());
+	graph.weights.resize(2 * edges.size());
+
+	// a row gets its smaller neighbors while the edges of those go by, then its own
+	// edges, so the rows come out sorted
+	std::vector<size_t> next(graph.offsets.begin(), graph.offsets.end() - 1);
+	for (size_t e = 0; e < edges.size(); e++)
+	{
+		size_t i = next[edges[e].u]++;
+		graph.targets[i] = edges[e].v;
+		graph.weights[i] = edges[e].weight;
+
+		size_t j = next[edges[e].v]++;
+		graph.targets[j] = edges[e].u;
+		graph.weights[j] = edges[e].weight;
+	}
+
+	std::vector<GraphEdge>().swap(edges);
+}
+
+
+void edgeWeights(const double *nx, const double *ny, const double *nz, size_t u,
+	const alglib::ae_int_t *neighbors, size_t k, double *weights)
+{
+	size_t j = 0;
+
+#ifdef __AVX2__
+	static_assert(sizeof(alglib::ae_int_t) == sizeof(long long), "the tags are gathered as 64 bit indices");
+
+	const __m256d ux = _mm256_set1_pd(nx[u]);
+	const __m256d uy = _mm256_set1_pd(ny[u]);
+	const __m256d uz = _mm256_set1_pd(nz[u]);
+	const __m256d one = _mm256_set1_pd(1.0);
+	const __m256d sign = _mm256_set1_pd(-0.0);
+
+	for (; j + 4 <= k; j += 4)
+	{
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(neighbors + j));
+
+		// no fused multiply-add, to round like the scalar tail
+		__m256d dot = _mm256_mul_pd(ux, _mm256_i64gather_pd(nx, v, sizeof(double)));
+		dot = _mm256_add_pd(dot, _mm256_mul_pd(uy, _mm256_i64gather_pd(ny, v, sizeof(double))));
+		dot = _mm256_add_pd(dot, _mm256_mul_pd(uz, _mm256_i64gather_pd(nz, v, sizeof(double))));
+
+		_mm256_storeu_pd(weights + j, _mm256_sub_pd(one, _mm256_andnot_pd(sign, dot)));
+	}
+#endif
+
+	for (; j < k; j++)
+	{
+		size_t v = size_t(neighbors[j]);
+		double dot = nx[u] * nx[v] + ny[u] * ny[v] + nz[u] * nz[v];
+		weights[j] = 1 - std::abs(dot);
+	}
+}
+
+
+size_t buildRiemannianGraph(
+	const alglib::kdtree& kdtCentroids,
+	const Vec3Arrays& centroids,
+	const Vec3Arrays& normals,
+	double radius,
+	RiemannianGraph& graph,
+	unsigned int nThreads)
+{
+	size_t nPoints = centroids.size();
+
+	// the edges every worker emits, concatenated in order
+	std::vector<std::vector<GraphEdge> > workerEdges(workerCount(nThreads));
+
+	parallelFor(nPoints, [&](size_t begin, size_t end, unsigned int worker)
+	{
+		// reused by every row, the tags only grow
+		alglib::kdtreerequestbuffer buffer;
+		alglib::kdtreecreaterequestbuffer(kdtCentroids, buffer);
+		alglib::real_1d_array queryCentroid;
+		queryCentroid.setlength(constants::dims);
+		alglib::integer_1d_array uNeighTags;
+		std::vector<double> weights;
+
+		std::vector<GraphEdge>& edges = workerEdges[worker];
+
+		for (size_t u = begin; u < end; u++)
+		{
+			// take the u point for query
+			for (size_t d = 0; d < constants::dims; d++)
+				queryCentroid[d] = centroids(u, d);
+
+			// query the kdtree for the neighbors, the tags are the point indices
+			alglib::ae_int_t k = alglib::kdtreetsqueryrnn(kdtCentroids, buffer, queryCentroid, radius);
+			alglib::kdtreetsqueryresultstags(kdtCentroids, buffer, uNeighTags);
+
+			// an edge with inverse normal weight to every neighbor v
+			if (weights.size() < size_t(k))
+				weights.resize(size_t(k));
+			edgeWeights(normals.x(), normals.y(), normals.z(), u, uNeighTags.getcontent(), size_t(k), weights.data());
+
+			for (alglib::ae_int_t j = 0; j < k; j++)
+			{
+				size_t v = size_t(uNeighTags[j]);
+				if (v == u)
+					continue;
+
+				GraphEdge edge = { u, v, weights[j] };
+				edges.push_back(edge);
+			}
+		}
+	}, nThreads);
+
+	size_t nEmitted = 0;
+	for (size_t w = 0; w < workerEdges.size(); w++)
+		nEmitted += workerEdges[w].size();
+
+	std::vector<GraphEdge> edges;
+	edges.reserve(nEmitted);
+	for (size_t w = 0; w < workerEdges.size(); w++)
+	{
+		edges.insert(edges.end(), workerEdges[w].begin(), workerEdges[w].end());
+		std::vector<GraphEdge>().swap(workerEdges[w]);
+	}
+
+	assembleGraph(edges, nPoints, graph);
+
+	return graph.nEdges();
+}
+
+
+size_t selectMstRoot(const Vec3Arrays& centroids)
+{
+	if (centroids.size() == 0)
+		return 0;
+
+	// the topmost centroid, its normal is the one surely pointing up (Hoppe's rule)
+	const double *z = centroids.z();
+	size_t top = 0;
+	for (size_t u = 1; u < centroids.size(); u++)
+		if (z[u] > z[top])
+			top = u;
+
+	return top;
+}
+
+
+namespace
+{
+	// a candidate edge to vertex in the heap, stale once the key of vertex changes
+	struct PrimCandidate
+	{
+		double key;
+		size_t vertex;
+	};
+
+	// the top of the heap is the least key, the largest vertex on ties
+	struct PrimOrder
+	{
+		bool operator()(const PrimCandidate& a, const PrimCandidate& b) const
+		{
+			return a.key > b.key || (a.key == b.key && a.vertex < b.vertex);
+		}
+	};
+}
+
+
+size_t* primMst(const RiemannianGraph& graph, size_t *parent, size_t root)
+{
+	size_t n = graph.nVertices();
+
+	// book keeping
+	std::vector<double> key(n, DBL_MAX);	// key values used to pick minimum weight edge in cut
+	std::vector<bool> mstSet(n, false);		// vertices already in the mst
+	std::priority_queue<PrimCandidate, std::vector<PrimCandidate>, PrimOrder> candidates;
+
+	key[root] = 0.0;
+	parent[root] = -1;
+	candidates.push(PrimCandidate { 0.0, root });
+
+	size_t last = root;			// the last vertex added
+	size_t unreached = n;		// vertices from here up are all in the mst
+
+	for (size_t count = 0; count < n; count++)
+	{
+		// pick the min of the pending ones
+		while (!candidates.empty() && (mstSet[candidates.top().vertex] || candidates.top().key != key[candidates.top().vertex]))
+			candidates.pop();
+
+		size_t u;
+		if (!candidates.empty())
+		{
+			u = candidates.top().vertex;
+			candidates.pop();
+		}
+		else
+		{
+			// nothing reachable is left, take the largest pending vertex
+			while (mstSet[unreached - 1])
+				unreached--;
+			u = unreached - 1;
+			parent[u] = last;
+		}
+
+		mstSet[u] = true;	// mark it in the MST
+		last = u;
+
+		// update keys for best current edges
+		for (size_t e = graph.offsets[u]; e < graph.offsets[u + 1]; e++)
+		{
+			size_t v = graph.targets[e];
+			if (mstSet[v] == false && graph.weights[e] <= key[v])
+			{
+				parent[v] = u;
+				if (graph.weights[e] < key[v])
+				{
+					key[v] = graph.weights[e];
+					candidates.push(PrimCandidate { key[v], v });
+				}
+			}
+		}
+	}
+
+	return parent;
+}
+
+
+void propagateNormals(size_t *graphMst, Vec3Arrays& normals, size_t root)
+{
+	double *x = normals.x(), *y = normals.y(), *z = normals.z();
+	size_t n = normals.size();
+
+	// children of every vertex, counted then placed (CSR), the root has no parent
+	std::vector<size_t> firstChild(n + 1, 0), children(n);
+	for (size_t u = 0; u < n; u++)
+		if (graphMst[u] < n)
+			firstChild[graphMst[u] + 1]++;
+
+	for (size_t u = 0; u < n; u++)
+		firstChild[u + 1] += firstChild[u];
+
+	std::vector<size_t> fill(firstChild.begin(), firstChild.end() - 1);
+	for (size_t u = 0; u < n; u++)
+		if (graphMst[u] < n)
+			children[fill[graphMst[u]]++] = u;
+
+	// down from the root with an explicit stack, a parent is settled before its children
+	std::vector<size_t> pending(1, root);
+	while (!pending.empty())
+	{
+		size_t parent = pending.back();
+		pending.pop_back();
+
+		for (size_t c = firstChild[parent]; c < firstChild[parent + 1]; c++)
+		{
+			size_t u = children[c];
+
+			// dot product of normals parent * child
+			double dot = 0;
+			dot += x[parent] * x[u];
+			dot += y[parent] * y[u];
+			dot += z[parent] * z[u];
+
+			// flip if neccesary
+			if (dot < 0)
+			{
+				x[u] *= -1;
+				y[u] *= -1;
+				z[u] *= -1;
+			}
+
+			pending.push_back(u);
+		}
+	}
+}
+
+
+void transferNormals(
+	const alglib::real_2d_array& samples,
+	const Vec3Arrays& sampleNormals,
+	size_t nSamples,
+	const alglib::real_2d_array& points,
+	size_t nPoints,
+	Vec3Arrays& normals,
+	unsigned int nThreads)
+{
+	normals.resize(nPoints);
+	if (nSamples == 0)
+		return;
+
+	// tags to sample index
+	alglib::integer_1d_array tags;
+	tags.setlength(nSamples);
+	for (size_t i = 0; i < nSamples; i++)
+		tags[i] = i;
+
+	alglib::kdtree kdtSamples;
+	buildTaggedKDTree(kdtSamples, samples, tags, nSamples, nThreads);
+
+	parallelFor(nPoints, [&](size_t begin, size_t end, unsigned int)
+	{
+		alglib::kdtreerequestbuffer buffer;
+		alglib::kdtreecreaterequestbuffer(kdtSamples, buffer);
+
+		alglib::real_1d_array queryPoint;
+		alglib::integer_1d_array nearest;
+		for (size_t i = begin; i < end; i++)
+		{
+			queryPoint.setcontent(constants::dims, points[i]);
+			alglib::kdtreetsqueryknn(kdtSamples, buffer, queryPoint, 1);
+			alglib::kdtreetsqueryresultstags(kdtSamples, buffer, nearest);
+
+			for (size_t d = 0; d < constants::dims; d++)
+				normals(i, d) = sampleNormals(size_t(nearest[0]), d);
+		}
+	}, nThreads);
+}
@@ -0,0 +1,262 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+#include "Libraries/alglib/alglibmisc.h"
+
+#include "Instrumentation.h"
+#include "PointArrays.h"
+
+
+/*
+	calculateCentroid
+
+		Estimates the center to the
+		best fitting plane of a set
+		of points in R(constants::dims) space. 
+		This centroid is the mean vector
+		of the set of points.
+*/
+
+alglib::real_1d_array calculateCentroid(const alglib::real_2d_array& points, alglib::ae_int_t k);
+
+
+/*
+	calculateNormal
+		
+		Estimates the normal to the 
+		best fitting plane of a set
+		of points in R(constants::dims) space. 
+		This normal is the eigenvector
+		corresponding to the least
+		eigenvalue of the covariance
+		matrix. Basically, PCA.
+*/
+
+alglib::real_1d_array calculateNormal(const alglib::real_2d_array& points, alglib::ae_int_t k);
+
+
+/*
+	PlaneScratch
+
+		The buffers of the plane fits of one worker:
+		its kdtree request buffer, query point and
+		neighborhood. They only grow, to the largest
+		neighborhood seen, so once warmed up the
+		fits allocate nothing.
+*/
+
+struct PlaneScratch
+{
+	alglib::kdtreerequestbuffer buffer;
+	alglib::real_1d_array queryPoint;
+	alglib::real_2d_array neighbors;	// the first k rows are the last neighborhood
+
+	explicit PlaneScratch(const alglib::kdtree& kdt);
+};
+
+
+/*
+	fitPlane
+
+		Centroid and normal of the radius
+		neighborhood of point, the normal being the
+		eigenvector of the least eigenvalue of the
+		3x3 covariance, found by Jacobi rotations
+		rather than alglib's PCA, which allocates
+		on every call. Neighborhoods that leave the
+		plane undetermined (fewer than 3 points, or
+		on a line) fall back to the PCA, to keep its
+		arbitrary choice. Returns the number of
+		neighbors.
+*/
+
+alglib::ae_int_t fitPlane(const alglib::kdtree& kdt, PlaneScratch& scratch, const double *point, double radius,
+	double *centroid, double *normal);
+
+
+/*
+	estimatePlanes
+
+		fitPlane on every point, into the structure
+		of arrays of centroids and normals. Points
+		are split in contiguous chunks, one per
+		worker, each with its own PlaneScratch; with
+		a trace every chunk is recorded as a span on
+		its worker.
+
+		With a log, the neighborhood, centroid and
+		normal of every point are written to it, on
+		a single thread to keep them in order.
+
+		Returns the total number of neighbors.
+*/
+
+size_t estimatePlanes(
+	const alglib::kdtree& kdt,
+	const alglib::real_2d_array& points,
+	size_t nPoints,
+	double radius,
+	Vec3Arrays& centroids,
+	Vec3Arrays& normals,
+	unsigned int nThreads = 0,
+	TraceRecorder *trace = NULL,
+	std::ostream *log = NULL);
+
+
+/*
+	RiemannianGraph
+
+		The Riemannian graph of the centroids in
+		compressed sparse rows: the neighbors of u
+		are targets[offsets[u]] to
+		targets[offsets[u + 1] - 1], in increasing
+		order, each with its weight. Every edge is
+		stored in both directions.
+*/
+
+struct RiemannianGraph
+{
+	std::vector<size_t> offsets;	// nVertices + 1
+	std::vector<size_t> targets;
+	std::vector<double> weights;
+
+	size_t nVertices() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+	size_t nEdges() const { return targets.size() / 2; }	// undirected
+
+	double weight(size_t u, size_t v) const;	// DBL_MAX without edge
+	void clear();
+};
+
+
+// an undirected edge, u < v once assembled
+struct GraphEdge
+{
+	size_t u;
+	size_t v;
+	double weight;
+};
+
+
+/*
+	assembleGraph
+
+		The graph of nVertices vertices with the
+		given edges, in either direction and
+		repeated any number of times: they are
+		sorted, the duplicates dropped, and both
+		directions of the rest laid out in rows.
+		Consumes edges.
+*/
+
+void assembleGraph(std::vector<GraphEdge>& edges, size_t nVertices, RiemannianGraph& graph);
+
+
+/*
+	edgeWeights
+
+		The weights 1 - | normal of u dot normal of v |
+		of u to every neighbor v at once, from the
+		components nx, ny, nz of the normals (see
+		Vec3Arrays).
+		With AVX2, four neighbors per step, gathered
+		by index; the scalar tail runs the same
+		operations in the same order, so an edge
+		weighs the same seen from either end.
+*/
+
+void edgeWeights(const double *nx, const double *ny, const double *nz, size_t u,
+	const alglib::ae_int_t *neighbors, size_t k, double *weights);
+
+
+/*
+	buildRiemannianGraph
+
+		Connects every centroid to those on its
+		neighborhood, with the edgeWeights of the
+		whole neighborhood computed at once. The
+		edges are emitted straight from the tags of
+		the radius queries, in contiguous chunks
+		per worker, and assembled once at the end,
+		which also makes the graph symmetric.
+
+		Returns the number of undirected edges.
+*/
+
+size_t buildRiemannianGraph(
+	const alglib::kdtree& kdtCentroids,
+	const Vec3Arrays& centroids,
+	const Vec3Arrays& normals,
+	double radius,
+	RiemannianGraph& graph,
+	unsigned int nThreads = 0);
+
+
+/*
+	selectMstRoot
+
+		The topmost centroid: on a closed surface
+		its normal points up, so the propagation
+		starts from its normal turned to +z
+		(Hoppe's rule).
+*/
+
+size_t selectMstRoot(const Vec3Arrays& centroids);
+
+
+/*
+	primMst
+
+		Prim's minimum spanning tree of the graph,
+		rooted at root, with a binary heap of the
+		candidate edges. Fills parent with the
+		parent of every vertex, the root's being -1.
+
+		A vertex the tree can't reach is attached
+		to the last vertex added, through an edge
+		missing from the graph (see
+		RiemannianGraph::weight), so the tree spans
+		every component. Ties go to the largest
+		vertex.
+
+		The propagation walks down from its root,
+		so both must be the same vertex.
+*/
+
+size_t* primMst(const RiemannianGraph& graph, size_t *parent, size_t root = 0);
+
+
+/*
+	propagateNormals
+
+		Flips the normals of the children of root
+		to agree with it, and so on down the MST.
+		The child lists are built once and walked
+		with an explicit stack, so the work is
+		linear and long MST paths cannot overflow
+		the call stack.
+*/
+
+void propagateNormals(size_t *graphMst, Vec3Arrays& normals, size_t root);
+
+
+/*
+	transferNormals
+
+		Gives every point the normal of its nearest
+		sample, to bring the normals estimated on a
+		downsampled cloud (see voxelDownsample) back
+		to the full one.
+*/
+
+void transferNormals(
+	const alglib::real_2d_array& samples,
+	const Vec3Arrays& sampleNormals,
+	size_t nSamples,
+	const alglib::real_2d_array& points,
+	size_t nPoints,
+	Vec3Arrays& normals,
+	unsigned int nThreads = 0);
+
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#ifdef FINALPROJECT_OPENMP
+#include <omp.h>
+#endif
+
+#include "Libraries/alglib/ap.h"
+
+
+/*
+	workerCount
+
+		Resolves a requested number of worker
+		threads, where 0 means one per hardware
+		thread (or OMP_NUM_THREADS in OpenMP builds).
+*/
+
+inline unsigned int workerCount(unsigned int nThreads = 0)
+{
+	if (nThreads == 0)
+#ifdef FINALPROJECT_OPENMP
+		nThreads = (unsigned int)omp_get_max_threads();
+#else
+		nThreads = std::thread::hardware_concurrency();
+#endif
+
+	return nThreads == 0 ? 1 : nThreads;
+}
+
+
+/*
+	parallelFor
+
+		Splits the range [0, n) in contiguous chunks,
+		one per worker, and calls body(begin, end, worker)
+		on each of them. The worker index can be used to
+		pick per-thread scratch state (kdtree request
+		buffers, accumulators, etc.). Worker w always
+		gets the w-th chunk, so per-worker outputs can
+		be concatenated back in order.
+
+		Runs on the calling thread when there is a
+		single worker or nothing worth splitting.
+
+		OpenMP builds (FINALPROJECT_OPENMP) run the
+		chunks on the OpenMP thread team instead of
+		spawning threads on every call, with the same
+		chunk to worker mapping.
+*/
+
+template <typename Body>
+void parallelFor(size_t n, Body body, unsigned int nThreads = 0)
+{
+	size_t nWorkers = std::min<size_t>(workerCount(nThreads), n);
+
+	if (nWorkers <= 1)
+	{
+		if (n > 0)
+			body(size_t(0), n, 0u);
+		return;
+	}
+
+	size_t chunk = (n + nWorkers - 1) / nWorkers;
+
+#ifdef FINALPROJECT_OPENMP
+	#pragma omp parallel num_threads(int(nWorkers))
+	{
+		// the runtime may grant a smaller team, its threads then take several chunks
+		for (size_t w = size_t(omp_get_thread_num()); w < nWorkers; w += size_t(omp_get_num_threads()))
+		{
+			size_t begin = w * chunk;
+			size_t end = std::min(n, begin + chunk);
+			if (begin < end)
+				body(begin, end, (unsigned int)w);
+		}
+	}
+#else
+	std::vector<std::thread> workers;
+	workers.reserve(nWorkers - 1);
+
+	// the calling thread takes the first chunk
+	for (size_t w = 1; w < nWorkers; w++)
+	{
+		size_t begin = w * chunk;
+		size_t end = std::min(n, begin + chunk);
+		if (begin >= end)
+			break;
+
+		workers.emplace_back(body, begin, end, (unsigned int)w);
+	}
+
+	body(size_t(0), std::min(n, chunk), 0u);
+
+	for (std::thread& worker : workers)
+		worker.join();
+#endif
+}
+
+
+/*
+	setAlglibWorkers
+
+		Sizes alglib's worker pool to the nThreads
+		workers of the pipeline (see workerCount).
+		The pool is global to the process, so the
+		driver sets it once, from its own thread
+		setting: main, a tile worker process or a
+		benchmark run, never a reconstructor.
+*/
+
+inline void setAlglibWorkers(unsigned int nThreads)
+{
+	alglib::setnworkers(alglib::ae_int_t(workerCount(nThreads)));
+}
+
+
+/*
+	alglibThreading
+
+		Threading of a heavy alglib call (kdtree
+		building, RBF fitting) made by a stage with
+		nThreads workers, outside its parallelFor
+		bodies: alglib::parallel, on the pool of
+		setAlglibWorkers, when there are several,
+		alglib::serial otherwise.
+
+		alglib's global default stays serial, so the
+		alglib calls inside parallelFor bodies, which
+		pass no xparams, don't add threads to the
+		workers already running. The free edition of
+		alglib runs serially whatever the xparams.
+*/
+
+inline alglib::xparams alglibThreading(unsigned int nThreads)
+{
+	return workerCount(nThreads) > 1 ? alglib::parallel : alglib::serial;
+}
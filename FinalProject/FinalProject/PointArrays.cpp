@@ -0,0 +1,134 @@
+#include "PointArrays.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+
+namespace
+{
+	double *allocateAligned(size_t n)
+	{
+		if (n == 0)
+			return NULL;
+
+		size_t bytes = (n * sizeof(double) + constants::cacheLine - 1) / constants::cacheLine * constants::cacheLine;
+
+#ifdef _WIN32
+		void *p = _aligned_malloc(bytes, constants::cacheLine);
+#else
+		void *p = NULL;
+		if (posix_memalign(&p, constants::cacheLine, bytes) != 0)
+			p = NULL;
+#endif
+		if (!p)
+			throw std::bad_alloc();
+		return static_cast<double*>(p);
+	}
+
+	void freeAligned(double *p)
+	{
+#ifdef _WIN32
+		_aligned_free(p);
+#else
+		std::free(p);
+#endif
+	}
+}
+
+
+Vec3View viewRows(const alglib::real_2d_array& rows, size_t n)
+{
+	Vec3View view;
+	view.size = n;
+	view.stride = n > 1 ? size_t(rows[1] - rows[0]) : 0;
+	for (size_t d = 0; d < 3; d++)
+		view.component[d] = n > 0 ? rows[0] + d : NULL;
+	return view;
+}
+
+
+Vec3Arrays::Vec3Arrays() : count(0)
+{
+	component[0] = component[1] = component[2] = NULL;
+}
+
+Vec3Arrays::Vec3Arrays(size_t n) : count(0)
+{
+	component[0] = component[1] = component[2] = NULL;
+	resize(n);
+}
+
+Vec3Arrays::Vec3Arrays(const Vec3Arrays& other) : count(0)
+{
+	component[0] = component[1] = component[2] = NULL;
+	resize(other.count);
+	for (size_t d = 0; d < 3; d++)
+		std::copy(other.component[d], other.component[d] + count, component[d]);
+}
+
+Vec3Arrays::Vec3Arrays(Vec3Arrays&& other) : count(0)
+{
+	component[0] = component[1] = component[2] = NULL;
+	swap(*this, other);
+}
+
+Vec3Arrays& Vec3Arrays::operator=(Vec3Arrays other)
+{
+	swap(*this, other);
+	return *this;
+}
+
+Vec3Arrays::~Vec3Arrays()
+{
+	for (size_t d = 0; d < 3; d++)
+		freeAligned(component[d]);
+}
+
+void Vec3Arrays::resize(size_t n)
+{
+	if (n == count)
+		return;
+
+	for (size_t d = 0; d < 3; d++)
+	{
+		freeAligned(component[d]);
+		component[d] = NULL;
+	}
+	count = 0;
+
+	for (size_t d = 0; d < 3; d++)
+		component[d] = allocateAligned(n);
+	count = n;
+}
+
+Vec3View Vec3Arrays::view() const
+{
+	Vec3View view;
+	view.size = count;
+	view.stride = 1;
+	for (size_t d = 0; d < 3; d++)
+		view.component[d] = component[d];
+	return view;
+}
+
+void swap(Vec3Arrays& a, Vec3Arrays& b)
+{
+	for (size_t d = 0; d < 3; d++)
+		std::swap(a.component[d], b.component[d]);
+	std::swap(a.count, b.count);
+}
+
+
+void copyRows(const Vec3View& vectors, alglib::real_2d_array& rows)
+{
+	rows.setlength(vectors.size, 3);
+	for (size_t i = 0; i < vectors.size; i++)
+		for (size_t d = 0; d < 3; d++)
+			rows[i][d] = vectors(i, d);
+}
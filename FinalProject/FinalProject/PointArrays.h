@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+
+#include "Libraries/alglib/ap.h"
+
+
+namespace constants
+{
+	const size_t cacheLine = 64; // bytes, alignment of the structure of arrays
+}
+
+
+/*
+	Vec3View
+
+		Read only span of size 3D vectors, whatever
+		their layout: component d of vector i is at
+		component[d][i * stride]. Vec3Arrays are
+		viewed with stride 1, an alglib matrix of
+		x, y, z rows with its row stride (see
+		viewRows), so the stages that read either
+		take a view instead of a copy.
+*/
+
+struct Vec3View
+{
+	const double *component[3];
+	size_t stride;
+	size_t size;
+
+	double operator()(size_t i, size_t d) const { return component[d][i * stride]; }
+};
+
+// the first n rows of an n x 3 (or wider) alglib matrix
+Vec3View viewRows(const alglib::real_2d_array& rows, size_t n);
+
+
+/*
+	Vec3Arrays
+
+		3D vectors as structure of arrays: x[],
+		y[] and z[], one cache line aligned
+		allocation each, so the per point stages
+		load every component contiguously, four
+		vectors at a time with AVX2. The centroids
+		and normals of the pipeline are stored this
+		way; the points stay alglib matrices, which
+		the kdtree copies on building anyway.
+*/
+
+class Vec3Arrays
+{
+public:
+	Vec3Arrays();
+	explicit Vec3Arrays(size_t n);
+	Vec3Arrays(const Vec3Arrays& other);
+	Vec3Arrays(Vec3Arrays&& other);
+	Vec3Arrays& operator=(Vec3Arrays other);
+	~Vec3Arrays();
+
+	void resize(size_t n);		// the contents are lost
+	void clear() { resize(0); }
+	size_t size() const { return count; }
+
+	double *x() { return component[0]; }
+	double *y() { return component[1]; }
+	double *z() { return component[2]; }
+	const double *x() const { return component[0]; }
+	const double *y() const { return component[1]; }
+	const double *z() const { return component[2]; }
+
+	double operator()(size_t i, size_t d) const { return component[d][i]; }
+	double& operator()(size_t i, size_t d) { return component[d][i]; }
+
+	void get(size_t i, double *v) const { v[0] = component[0][i]; v[1] = component[1][i]; v[2] = component[2][i]; }
+	void set(size_t i, const double *v) { component[0][i] = v[0]; component[1][i] = v[1]; component[2][i] = v[2]; }
+
+	Vec3View view() const;
+
+	friend void swap(Vec3Arrays& a, Vec3Arrays& b);
+
+private:
+	double *component[3];
+	size_t count;
+};
+
+
+// the vectors as the rows of an alglib matrix, for alglib (kdtree building)
+void copyRows(const Vec3View& vectors, alglib::real_2d_array& rows);
@@ -0,0 +1,1156 @@
+#include "PointCloud.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+#include "MappedFile.h"
+#include "Parallel.h"
+
+
+namespace
+{
+	// points per block of the cloud writers, a few MB of output
+	const size_t writeBlock = 1 << 16;
+
+	std::string lowerExtension(const std::string& filename)
+	{
+		size_t dot = filename.find_last_of('.');
+		std::string extension = dot == std::string::npos ? "" : filename.substr(dot + 1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		return extension;
+	}
+
+	bool littleEndianHost()
+	{
+		const uint16_t one = 1;
+		unsigned char first;
+		std::memcpy(&first, &one, 1);
+		return first == 1;
+	}
+
+
+	// PLY scalar types, in the order of plyTypeNames
+	enum PlyType
+	{
+		PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64, PLY_INVALID
+	};
+
+	bool parsePlyType(const std::string& name, PlyType& type)
+	{
+		// PLY 1.0 names and their sized aliases
+		const char *names[] = { "char", "uchar", "short", "ushort", "int", "uint", "float", "double" };
+		const char *aliases[] = { "int8", "uint8", "int16", "uint16", "int32", "uint32", "float32", "float64" };
+		for (int t = 0; t < PLY_INVALID; t++)
+			if (name == names[t] || name == aliases[t])
+			{
+				type = PlyType(t);
+				return true;
+			}
+		return false;
+	}
+
+	size_t plyTypeSize(PlyType type)
+	{
+		const size_t sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+		return sizes[type];
+	}
+
+	template <typename T>
+	double decodePlyScalar(const char *bytes, bool swap)
+	{
+		char buffer[sizeof(T)];
+		std::memcpy(buffer, bytes, sizeof(T));
+		if (swap)
+			std::reverse(buffer, buffer + sizeof(T));
+
+		T value;
+		std::memcpy(&value, buffer, sizeof(T));
+		return double(value);
+	}
+
+	double decodePly(const char *bytes, PlyType type, bool swap)
+	{
+		switch (type)
+		{
+		case PLY_INT8: return decodePlyScalar<int8_t>(bytes, swap);
+		case PLY_UINT8: return decodePlyScalar<uint8_t>(bytes, swap);
+		case PLY_INT16: return decodePlyScalar<int16_t>(bytes, swap);
+		case PLY_UINT16: return decodePlyScalar<uint16_t>(bytes, swap);
+		case PLY_INT32: return decodePlyScalar<int32_t>(bytes, swap);
+		case PLY_UINT32: return decodePlyScalar<uint32_t>(bytes, swap);
+		case PLY_FLOAT32: return decodePlyScalar<float>(bytes, swap);
+		case PLY_FLOAT64: return decodePlyScalar<double>(bytes, swap);
+		default: return 0;
+		}
+	}
+
+	struct PlyProperty
+	{
+		std::string name;
+		PlyType type;
+		bool list;
+		PlyType countType;		// type of the length of a list
+	};
+
+	struct PlyElement
+	{
+		std::string name;
+		size_t count;
+		std::vector<PlyProperty> properties;
+	};
+
+	// the bytes of one record of an element without lists
+	size_t plyRecordSize(const PlyElement& element)
+	{
+		size_t size = 0;
+		for (size_t p = 0; p < element.properties.size(); p++)
+			size += plyTypeSize(element.properties[p].type);
+		return size;
+	}
+
+	// offset of a scalar vertex property, PLY_INVALID type if missing
+	struct PlyField
+	{
+		size_t offset;
+		PlyType type;
+
+		PlyField() : offset(0), type(PLY_INVALID) {}
+	};
+
+	// x y z, nx ny nz and intensity
+	const int PLY_FIELDS = 7;
+
+	int plyField(const std::string& name)
+	{
+		const char *names[] = { "x", "y", "z", "nx", "ny", "nz", "intensity" };
+		for (int f = 0; f < PLY_FIELDS; f++)
+			if (name == names[f])
+				return f;
+		return name == "scalar_intensity" ? 6 : -1;
+	}
+
+	// where the vertices of a mapped PLY file are and how to decode them
+	struct PlyLayout
+	{
+		PlyElement vertices;
+		PlyField fields[PLY_FIELDS];
+		bool hasLists;
+		size_t stride;					// bytes per vertex without lists
+		bool swap;						// the file and host byte orders differ
+		const char *body;				// first vertex record
+		const char *end;				// end of the file
+	};
+
+	bool parsePlyHeader(const MappedFile& file, const std::string& filename, PlyLayout& layout)
+	{
+		const char *data = file.data();
+		const char *fileEnd = data + file.size();
+
+		// header, one line at a time up to end_header
+		std::vector<PlyElement> elements;
+		bool bigEndian = false;
+		bool gotFormat = false;
+		const char *cursor = data;
+		const char *body = NULL;
+
+		for (size_t lineNumber = 1; cursor < fileEnd; lineNumber++)
+		{
+			const char *lineEnd = std::find(cursor, fileEnd, '\n');
+			std::string line(cursor, lineEnd);
+			if (!line.empty() && line[line.size() - 1] == '\r')
+				line.erase(line.size() - 1);
+			cursor = lineEnd < fileEnd ? lineEnd + 1 : fileEnd;
+
+			std::istringstream words(line);
+			std::string keyword;
+			words >> keyword;
+
+			if (lineNumber == 1)
+			{
+				if (keyword != "ply")
+				{
+					std::cerr << filename << ": not a PLY file" << std::endl;
+					return false;
+				}
+				continue;
+			}
+
+			if (keyword == "format")
+			{
+				std::string format;
+				words >> format;
+				if (format == "ascii")
+				{
+					std::cerr << filename << ": ascii PLY is not supported, only binary_little_endian and binary_big_endian" << std::endl;
+					return false;
+				}
+				if (format != "binary_little_endian" && format != "binary_big_endian")
+				{
+					std::cerr << filename << ":" << lineNumber << ": unknown PLY format " << format << std::endl;
+					return false;
+				}
+				bigEndian = format == "binary_big_endian";
+				gotFormat = true;
+			}
+			else if (keyword == "element")
+			{
+				PlyElement element;
+				words >> element.name >> element.count;
+				if (!words)
+				{
+					std::cerr << filename << ":" << lineNumber << ": malformed element" << std::endl;
+					return false;
+				}
+				elements.push_back(element);
+			}
+			else if (keyword == "property")
+			{
+				PlyProperty property;
+				std::string type;
+				words >> type;
+				property.list = type == "list";
+				property.countType = PLY_INVALID;
+
+				bool valid = !elements.empty();
+				if (property.list)
+				{
+					std::string countType;
+					words >> countType >> type;
+					valid = valid && parsePlyType(countType, property.countType);
+				}
+				words >> property.name;
+				valid = valid && words && parsePlyType(type, property.type);
+
+				if (!valid)
+				{
+					std::cerr << filename << ":" << lineNumber << ": malformed property" << std::endl;
+					return false;
+				}
+				elements.back().properties.push_back(property);
+			}
+			else if (keyword == "end_header")
+			{
+				body = cursor;
+				break;
+			}
+			// comment, obj_info and unknown keywords are ignored
+		}
+
+		if (!body || !gotFormat)
+		{
+			std::cerr << filename << ": incomplete PLY header" << std::endl;
+			return false;
+		}
+
+		// skip the elements before the vertices, they must have fixed size records
+		size_t vertexElement = 0;
+		while (vertexElement < elements.size() && elements[vertexElement].name != "vertex")
+		{
+			const PlyElement& element = elements[vertexElement];
+			for (size_t p = 0; p < element.properties.size(); p++)
+				if (element.properties[p].list)
+				{
+					std::cerr << filename << ": lists are only supported in the vertex element" << std::endl;
+					return false;
+				}
+
+			size_t skip = element.count * plyRecordSize(element);
+			if (skip > size_t(fileEnd - body))
+			{
+				std::cerr << filename << ": truncated PLY body" << std::endl;
+				return false;
+			}
+			body += skip;
+			vertexElement++;
+		}
+
+		if (vertexElement == elements.size())
+		{
+			std::cerr << filename << ": no vertex element" << std::endl;
+			return false;
+		}
+
+		// where each wanted property sits in a vertex record
+		layout.vertices = elements[vertexElement];
+		layout.hasLists = false;
+		layout.stride = 0;
+
+		// the smallest a vertex record can be, with every list empty
+		size_t minimalRecord = 0;
+
+		for (size_t p = 0; p < layout.vertices.properties.size(); p++)
+		{
+			const PlyProperty& property = layout.vertices.properties[p];
+			layout.hasLists = layout.hasLists || property.list;
+			minimalRecord += plyTypeSize(property.list ? property.countType : property.type);
+
+			int f = plyField(property.name);
+			if (f >= 0 && !property.list && layout.fields[f].type == PLY_INVALID)
+			{
+				layout.fields[f].offset = layout.stride;
+				layout.fields[f].type = property.type;
+			}
+
+			layout.stride += plyTypeSize(property.type);
+		}
+
+		if (layout.fields[0].type == PLY_INVALID || layout.fields[1].type == PLY_INVALID || layout.fields[2].type == PLY_INVALID)
+		{
+			std::cerr << filename << ": the vertices have no x, y and z" << std::endl;
+			return false;
+		}
+
+		// checked before anything is allocated for the vertices, lists or not
+		if (layout.vertices.count > size_t(fileEnd - body) / std::max<size_t>(minimalRecord, 1))
+		{
+			std::cerr << filename << ": truncated PLY body" << std::endl;
+			return false;
+		}
+
+		layout.swap = bigEndian == littleEndianHost();
+		layout.body = body;
+		layout.end = fileEnd;
+		return true;
+	}
+
+	bool hasPlyNormals(const PlyLayout& layout)
+	{
+		return layout.fields[3].type != PLY_INVALID && layout.fields[4].type != PLY_INVALID && layout.fields[5].type != PLY_INVALID;
+	}
+
+	/*
+		Decodes the vertex at record into xyz and,
+		if not NULL, normal and intensity, and moves
+		record to the next one. Records with lists
+		have variable size: the scalars after a list
+		move with it, so their offsets are updated in
+		the layout.
+	*/
+	bool decodePlyVertex(PlyLayout& layout, const char *&record, double *xyz, double *normal, double *intensity)
+	{
+		const char *next = record + layout.stride;
+
+		if (layout.hasLists)
+		{
+			next = record;
+			for (size_t p = 0; p < layout.vertices.properties.size(); p++)
+			{
+				const PlyProperty& property = layout.vertices.properties[p];
+				size_t count = 1;
+				if (property.list)
+				{
+					if (plyTypeSize(property.countType) > size_t(layout.end - next))
+						return false;
+					count = size_t(decodePly(next, property.countType, layout.swap));
+					next += plyTypeSize(property.countType);
+				}
+				else
+				{
+					int f = plyField(property.name);
+					if (f >= 0 && layout.fields[f].type == property.type)
+						layout.fields[f].offset = size_t(next - record);
+				}
+
+				if (count * plyTypeSize(property.type) > size_t(layout.end - next))
+					return false;
+				next += count * plyTypeSize(property.type);
+			}
+		}
+
+		const PlyField *fields = layout.fields;
+		for (size_t d = 0; d < constants::dims; d++)
+		{
+			xyz[d] = decodePly(record + fields[d].offset, fields[d].type, layout.swap);
+			if (normal)
+				normal[d] = decodePly(record + fields[3 + d].offset, fields[3 + d].type, layout.swap);
+		}
+		if (intensity)
+			*intensity = decodePly(record + fields[6].offset, fields[6].type, layout.swap);
+
+		record = next;
+		return true;
+	}
+}
+
+
+bool loadCloud(tinyobj::attrib_t& attrib, const std::string& filename)
+{
+	// dummy vectors... we won't use them, we only need vertex info
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+
+	// error string buffer
+	std::string err, warn;
+
+	// load the obj file
+	bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename.c_str(), NULL, false, true);
+
+	// display errors and warnings
+	if (!err.empty()) {
+		std::cerr << err << std::endl;
+	}
+	if (!warn.empty()) {
+		std::cerr << warn << std::endl;
+	}
+
+	return ret;
+}
+
+
+CloudFormat detectCloudFormat(const std::string& filename)
+{
+	std::string extension = lowerExtension(filename);
+
+	if (extension == "obj")
+		return FORMAT_OBJ;
+	if (extension == "xyz" || extension == "pts" || extension == "txt")
+		return FORMAT_XYZ;
+	if (extension == "ply")
+		return FORMAT_PLY;
+
+	// sniff the first meaningful line
+	std::ifstream in(filename.c_str());
+	std::string line;
+	while (std::getline(in, line))
+	{
+		size_t first = line.find_first_not_of(" \t\r");
+		if (first == std::string::npos || line[first] == '#')
+			continue;
+
+		if (line.compare(first, 3, "ply") == 0 && line.find_first_not_of(" \t\r", first + 3) == std::string::npos)
+			return FORMAT_PLY;
+
+		if (line[first] == 'v' && first + 1 < line.size() && std::isspace((unsigned char)line[first + 1]))
+			return FORMAT_OBJ;
+
+		char *end;
+		std::strtod(line.c_str() + first, &end);
+		return end != line.c_str() + first ? FORMAT_XYZ : FORMAT_UNKNOWN;
+	}
+
+	return FORMAT_UNKNOWN;
+}
+
+
+bool loadXyz(const std::string& filename, alglib::real_2d_array& points, size_t& nPoints)
+{
+	PointStream stream;
+	if (!stream.open(filename, FORMAT_XYZ))
+		return false;
+
+	std::vector<double> coordinates;
+	const size_t block = 1 << 14;
+	for (size_t count = 1; count > 0; )
+	{
+		size_t filled = coordinates.size();
+		coordinates.resize(filled + block * constants::dims);
+		count = stream.read(&coordinates[filled], block);
+		coordinates.resize(filled + count * constants::dims);
+	}
+
+	if (stream.failed())
+		return false;
+
+	nPoints = coordinates.size() / constants::dims;
+	points.setlength(nPoints, constants::dims);
+	for (size_t i = 0; i < nPoints; i++)
+		for (size_t d = 0; d < constants::dims; d++)
+			points[i][d] = coordinates[i * constants::dims + d];
+
+	return true;
+}
+
+
+bool loadPly(const std::string& filename, alglib::real_2d_array& points, size_t& nPoints, alglib::real_2d_array *normals, alglib::real_1d_array *intensity)
+{
+	MappedFile file;
+	if (!file.open(filename))
+	{
+		std::cerr << "Cannot open " << filename << std::endl;
+		return false;
+	}
+
+	PlyLayout layout;
+	if (!parsePlyHeader(file, filename, layout))
+		return false;
+
+	bool withNormals = normals && hasPlyNormals(layout);
+	bool withIntensity = intensity && layout.fields[6].type != PLY_INVALID;
+
+	nPoints = layout.vertices.count;
+	points.setlength(nPoints, constants::dims);
+	if (normals)
+		normals->setlength(withNormals ? nPoints : 0, constants::dims);
+	if (intensity)
+		intensity->setlength(withIntensity ? nPoints : 0);
+
+	// decoded in place, straight into the rows
+	const char *record = layout.body;
+	for (size_t i = 0; i < nPoints; i++)
+		if (!decodePlyVertex(layout, record, points[i], withNormals ? (*normals)[i] : NULL, withIntensity ? &(*intensity)[i] : NULL))
+		{
+			std::cerr << filename << ": truncated PLY body" << std::endl;
+			return false;
+		}
+
+	return true;
+}
+
+
+bool loadPoints(const std::string& filename, alglib::real_2d_array& points, size_t& nPoints, CloudFormat format)
+{
+	if (format == FORMAT_UNKNOWN)
+		format = detectCloudFormat(filename);
+
+	if (format == FORMAT_XYZ)
+		return loadXyz(filename, points, nPoints);
+
+	if (format == FORMAT_PLY)
+		return loadPly(filename, points, nPoints);
+
+	if (format == FORMAT_OBJ)
+	{
+		tinyobj::attrib_t cloud;
+		if (!loadCloud(cloud, filename))
+			return false;
+
+		nPoints = cloud.vertices.size() / constants::dims;
+		adaptDataPoints(cloud.vertices, nPoints, points);
+		return true;
+	}
+
+	std::cerr << "Unknown point cloud format: " << filename << std::endl;
+	return false;
+}
+
+
+struct PointStream::Impl
+{
+	CloudFormat format;
+	std::string filename;
+
+	// text formats
+	std::ifstream in;
+	size_t lineNumber;
+
+	// PLY
+	MappedFile file;
+	PlyLayout layout;
+	const char *record;
+	size_t nRead;
+
+	bool failed;
+
+	Impl() : format(FORMAT_UNKNOWN), lineNumber(0), record(NULL), nRead(0), failed(false) {}
+
+	// the next point of a text file, false at the end or on a malformed line
+	bool readLine(double *xyz)
+	{
+		std::string line;
+		while (std::getline(in, line))
+		{
+			lineNumber++;
+
+			size_t first = line.find_first_not_of(" \t\r");
+			if (first == std::string::npos || line[first] == '#')
+				continue;
+
+			// OBJ clouds only use the vertex lines
+			if (format == FORMAT_OBJ)
+			{
+				if (line[first] != 'v' || first + 1 >= line.size() || !std::isspace((unsigned char)line[first + 1]))
+					continue;
+				first += 1;
+			}
+
+			const char *cursor = line.c_str() + first;
+			for (size_t d = 0; d < constants::dims; d++)
+			{
+				char *end;
+				xyz[d] = std::strtod(cursor, &end);
+				if (end == cursor)
+				{
+					std::cerr << filename << ":" << lineNumber << ": expected " << constants::dims << " coordinates" << std::endl;
+					failed = true;
+					return false;
+				}
+				cursor = end;
+			}
+			return true;
+		}
+		return false;
+	}
+};
+
+PointStream::PointStream()
+	: impl(new Impl)
+{
+}
+
+PointStream::~PointStream()
+{
+}
+
+bool PointStream::open(const std::string& filename, CloudFormat format)
+{
+	impl.reset(new Impl);
+	impl->filename = filename;
+	impl->format = format == FORMAT_UNKNOWN ? detectCloudFormat(filename) : format;
+
+	if (impl->format == FORMAT_PLY)
+	{
+		if (!impl->file.open(filename))
+		{
+			std::cerr << "Cannot open " << filename << std::endl;
+			return false;
+		}
+		if (!parsePlyHeader(impl->file, filename, impl->layout))
+			return false;
+		impl->record = impl->layout.body;
+		return true;
+	}
+
+	if (impl->format == FORMAT_OBJ || impl->format == FORMAT_XYZ)
+	{
+		impl->in.open(filename.c_str());
+		if (!impl->in)
+		{
+			std::cerr << "Cannot open " << filename << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	std::cerr << "Unknown point cloud format: " << filename << std::endl;
+	return false;
+}
+
+size_t PointStream::read(double *xyz, size_t maxPoints)
+{
+	size_t count = 0;
+
+	if (impl->format == FORMAT_PLY && impl->record)
+	{
+		for (; count < maxPoints && impl->nRead < impl->layout.vertices.count; count++, impl->nRead++)
+			if (!decodePlyVertex(impl->layout, impl->record, xyz + count * constants::dims, NULL, NULL))
+			{
+				std::cerr << impl->filename << ": truncated PLY body" << std::endl;
+				impl->failed = true;
+				impl->record = NULL;
+				break;
+			}
+		return count;
+	}
+
+	if (impl->in.is_open())
+		while (count < maxPoints && impl->readLine(xyz + count * constants::dims))
+			count++;
+
+	return count;
+}
+
+bool PointStream::failed() const
+{
+	return impl->failed;
+}
+
+
+OrientedCloudWriter::OrientedCloudWriter()
+	: format(FORMAT_UNKNOWN), nThreads(0), nPoints(0), nWritten(0)
+{
+}
+
+OrientedCloudWriter::~OrientedCloudWriter()
+{
+	close();
+}
+
+bool OrientedCloudWriter::open(const std::string& filename, size_t n, CloudFormat f, unsigned int threads)
+{
+	close();
+
+	format = f == FORMAT_UNKNOWN ? (lowerExtension(filename) == "ply" ? FORMAT_PLY : FORMAT_XYZ) : f;
+	if (format != FORMAT_PLY && format != FORMAT_XYZ)
+	{
+		std::cerr << "Oriented clouds are written as PLY or XYZ: " << filename << std::endl;
+		return false;
+	}
+
+	nThreads = threads;
+	nPoints = n;
+	nWritten = 0;
+
+	out.clear();
+	out.open(filename.c_str(), std::ios::binary);
+	if (!out)
+		return false;
+
+	if (format == FORMAT_PLY)
+		out << "ply\n"
+			<< "format binary_little_endian 1.0\n"
+			<< "comment oriented point cloud\n"
+			<< "element vertex " << nPoints << "\n"
+			<< "property float x\nproperty float y\nproperty float z\n"
+			<< "property float nx\nproperty float ny\nproperty float nz\n"
+			<< "end_header\n";
+
+	return bool(out);
+}
+
+bool OrientedCloudWriter::write(const double *xyz, const double *normals, size_t count)
+{
+	if (!out.is_open() || nWritten + count > nPoints)
+		return false;
+
+	for (size_t first = 0; first < count; first += writeBlock)
+	{
+		size_t blockSize = std::min(writeBlock, count - first);
+		const double *p = xyz + first * constants::dims;
+		const double *n = normals + first * constants::dims;
+
+		if (format == FORMAT_PLY)
+		{
+			floats.resize(blockSize * 6);
+			for (size_t i = 0; i < blockSize; i++)
+				for (size_t d = 0; d < constants::dims; d++)
+				{
+					floats[i * 6 + d] = float(p[i * constants::dims + d]);
+					floats[i * 6 + 3 + d] = float(n[i * constants::dims + d]);
+				}
+
+			if (!littleEndianHost())
+			{
+				char *bytes = reinterpret_cast<char*>(floats.data());
+				for (size_t b = 0; b < blockSize * 6 * sizeof(float); b += sizeof(float))
+				{
+					std::swap(bytes[b], bytes[b + 3]);
+					std::swap(bytes[b + 1], bytes[b + 2]);
+				}
+			}
+
+			out.write(reinterpret_cast<const char*>(floats.data()), std::streamsize(blockSize * 6 * sizeof(float)));
+		}
+		else
+		{
+			// every worker formats a run of lines of the block, then they are written in order
+			unsigned int nWorkers = workerCount(nThreads);
+			text.resize(nWorkers);
+
+			parallelFor(blockSize, [&](size_t begin, size_t end, unsigned int worker)
+			{
+				std::string& lines = text[worker];
+				lines.clear();
+
+				// enough digits to round-trip the float input, as saveMesh
+				char line[192];
+				for (size_t i = begin; i < end; i++)
+				{
+					const double *pi = p + i * constants::dims;
+					const double *ni = n + i * constants::dims;
+					int length = std::snprintf(line, sizeof(line), "%.9g %.9g %.9g %.9g %.9g %.9g\n", pi[0], pi[1], pi[2], ni[0], ni[1], ni[2]);
+					lines.append(line, size_t(length));
+				}
+			}, nWorkers);
+
+			for (size_t w = 0; w < text.size(); w++)
+			{
+				out.write(text[w].data(), std::streamsize(text[w].size()));
+				text[w].clear();
+			}
+		}
+	}
+
+	nWritten += count;
+	return bool(out);
+}
+
+bool OrientedCloudWriter::close()
+{
+	if (!out.is_open())
+		return false;
+
+	out.close();
+	return !out.fail() && nWritten == nPoints;
+}
+
+
+bool saveOrientedCloud(const std::string& filename, const Vec3View& points, const Vec3View& normals, CloudFormat format, unsigned int nThreads)
+{
+	size_t nPoints = points.size;
+
+	OrientedCloudWriter writer;
+	if (!writer.open(filename, nPoints, format, nThreads))
+		return false;
+
+	// gathered from either layout to interleaved blocks
+	std::vector<double> blockPoints, blockNormals;
+	for (size_t first = 0; first < nPoints; first += writeBlock)
+	{
+		size_t count = std::min(writeBlock, nPoints - first);
+		blockPoints.resize(count * constants::dims);
+		blockNormals.resize(count * constants::dims);
+
+		for (size_t i = 0; i < count; i++)
+			for (size_t d = 0; d < constants::dims; d++)
+			{
+				blockPoints[i * constants::dims + d] = points(first + i, d);
+				blockNormals[i * constants::dims + d] = normals(first + i, d);
+			}
+
+		if (!writer.write(blockPoints.data(), blockNormals.data(), count))
+			return false;
+	}
+
+	return writer.close();
+}
+
+
+alglib::real_2d_array& adaptDataPoints(const std::vector<tinyobj::real_t>& vertices, const size_t numberOfVertices, alglib::real_2d_array& points)
+{
+	points.setlength(numberOfVertices, constants::dims);
+
+	for (size_t vertex = 0; vertex < numberOfVertices; vertex++)
+	{
+		// write d consequent values
+		size_t marker = vertex * constants::dims;
+		for (size_t d = 0; d < constants::dims; d++)
+			points[vertex][d] = vertices[marker + d];
+	}
+	
+	return points;
+}
+
+
+alglib::kdtree& buildKDTree(alglib::kdtree& kdt, const alglib::real_2d_array& points, const alglib::ae_int_t n, unsigned int nThreads)
+{
+	alglib::ae_int_t xdims = constants::dims, ydims = 0, normType = constants::kdtTreeNormType;
+	alglib::kdtreebuild(points, n, xdims, ydims, normType, kdt, alglibThreading(nThreads));
+	return kdt;
+}
+
+alglib::kdtree& buildTaggedKDTree(alglib::kdtree& kdt, const alglib::real_2d_array& points, const alglib::integer_1d_array& tags, const alglib::ae_int_t n,
+	unsigned int nThreads)
+{
+	alglib::ae_int_t xdims = constants::dims, ydims = 0, normType = constants::kdtTreeNormType;
+	alglib::kdtreebuildtagged(points, tags, n, xdims, ydims, normType, kdt, alglibThreading(nThreads));
+	return kdt;
+}
+
+
+namespace
+{
+	struct VoxelKey
+	{
+		int64_t cell[3];
+
+		bool operator==(const VoxelKey& other) const
+		{
+			return cell[0] == other.cell[0] && cell[1] == other.cell[1] && cell[2] == other.cell[2];
+		}
+	};
+
+	struct VoxelKeyHash
+	{
+		size_t operator()(const VoxelKey& key) const
+		{
+			uint64_t h = uint64_t(key.cell[0]) * 0x9E3779B97F4A7C15ULL;
+			h ^= uint64_t(key.cell[1]) * 0xC2B2AE3D27D4EB4FULL + (h << 6) + (h >> 2);
+			h ^= uint64_t(key.cell[2]) * 0x165667B19E3779F9ULL + (h << 6) + (h >> 2);
+			return size_t(h ^ (h >> 32));
+		}
+	};
+
+	// cell -> first point, then cell index
+	typedef std::unordered_map<VoxelKey, size_t, VoxelKeyHash> VoxelMap;
+
+	VoxelKey voxelOf(const double *p, const double *origin, double voxelSize)
+	{
+		VoxelKey key;
+		for (int d = 0; d < 3; d++)
+			key.cell[d] = int64_t(std::floor((p[d] - origin[d]) / voxelSize));
+		return key;
+	}
+}
+
+
+size_t voxelDownsample(const alglib::real_2d_array& points, size_t nPoints, double voxelSize, VoxelReduction reduction,
+	alglib::real_2d_array& samples, unsigned int nThreads)
+{
+	if (nPoints == 0 || !(voxelSize > 0))
+	{
+		samples = points;
+		return nPoints;
+	}
+
+	size_t nWorkers = std::min<size_t>(workerCount(nThreads), nPoints);
+
+	// lower corner of the grid
+	std::vector<double> lower(3 * nWorkers, DBL_MAX);
+	parallelFor(nPoints, [&](size_t begin, size_t end, unsigned int worker)
+	{
+		double *l = &lower[3 * worker];
+		for (size_t i = begin; i < end; i++)
+			for (int d = 0; d < 3; d++)
+				l[d] = std::min(l[d], points[i][d]);
+	}, unsigned(nWorkers));
+
+	double origin[3] = { DBL_MAX, DBL_MAX, DBL_MAX };
+	for (size_t w = 0; w < nWorkers; w++)
+		for (int d = 0; d < 3; d++)
+			origin[d] = std::min(origin[d], lower[3 * w + d]);
+
+	// the occupied cells of every chunk, then of the cloud: the chunks are
+	// in input order, so the first chunk to see a cell has its first point
+	std::vector<VoxelMap> chunkCells(nWorkers);
+	parallelFor(nPoints, [&](size_t begin, size_t end, unsigned int worker)
+	{
+		VoxelMap& cells = chunkCells[worker];
+		cells.reserve(end - begin);
+		for (size_t i = begin; i < end; i++)
+			cells.emplace(voxelOf(points[i], origin, voxelSize), i);
+	}, unsigned(nWorkers));
+
+	VoxelMap cells;
+	cells.swap(chunkCells[0]);
+	for (size_t w = 1; w < nWorkers; w++)
+	{
+		cells.insert(chunkCells[w].begin(), chunkCells[w].end());
+		VoxelMap().swap(chunkCells[w]);
+	}
+
+	// cells numbered in the order of their first point
+	const size_t noCell = ~size_t(0);
+	std::vector<size_t> cellOf(nPoints, noCell);
+	for (VoxelMap::const_iterator c = cells.begin(); c != cells.end(); ++c)
+		cellOf[c->second] = 0;
+
+	size_t nSamples = 0;
+	for (size_t i = 0; i < nPoints; i++)
+		if (cellOf[i] != noCell)
+			cellOf[i] = nSamples++;
+
+	for (VoxelMap::iterator c = cells.begin(); c != cells.end(); ++c)
+		c->second = cellOf[c->second];
+
+	parallelFor(nPoints, [&](size_t begin, size_t end, unsigned int)
+	{
+		for (size_t i = begin; i < end; i++)
+			cellOf[i] = cells.find(voxelOf(points[i], origin, voxelSize))->second;
+	}, unsigned(nWorkers));
+
+	// points of every cell, in input order
+	std::vector<size_t> cellStart(nSamples + 1, 0);
+	for (size_t i = 0; i < nPoints; i++)
+		cellStart[cellOf[i] + 1]++;
+	for (size_t c = 0; c < nSamples; c++)
+		cellStart[c + 1] += cellStart[c];
+
+	std::vector<size_t> members(nPoints);
+	{
+		std::vector<size_t> next(cellStart.begin(), cellStart.end() - 1);
+		for (size_t i = 0; i < nPoints; i++)
+			members[next[cellOf[i]]++] = i;
+	}
+
+	samples.setlength(nSamples, constants::dims);
+	parallelFor(nSamples, [&](size_t begin, size_t end, unsigned int)
+	{
+		for (size_t c = begin; c < end; c++)
+		{
+			double mean[3] = { 0, 0, 0 };
+			for (size_t m = cellStart[c]; m < cellStart[c + 1]; m++)
+				for (int d = 0; d < 3; d++)
+					mean[d] += points[members[m]][d];
+
+			double count = double(cellStart[c + 1] - cellStart[c]);
+			for (int d = 0; d < 3; d++)
+				mean[d] /= count;
+
+			const double *kept = mean;
+			if (reduction == VOXEL_POINT)
+			{
+				double closest = DBL_MAX;
+				for (size_t m = cellStart[c]; m < cellStart[c + 1]; m++)
+				{
+					const double *p = points[members[m]];
+					double dx = p[0] - mean[0], dy = p[1] - mean[1], dz = p[2] - mean[2];
+					double distance = dx * dx + dy * dy + dz * dz;
+					if (distance < closest)
+					{
+						closest = distance;
+						kept = p;
+					}
+				}
+			}
+
+			for (int d = 0; d < 3; d++)
+				samples[c][d] = kept[d];
+		}
+	}, nThreads);
+
+	return nSamples;
+}
+
+
+alglib::ae_int_t getKNeighbors(alglib::kdtree& kdt, alglib::real_2d_array& result, const alglib::real_1d_array& queryPoint, double radius)
+{
+	// query tree for a given point around a radius
+	alglib::ae_int_t k = alglib::kdtreequeryrnn(kdt, queryPoint, radius);
+
+	// the queried results are in an internal buffer of the tree
+	result.setlength(k, constants::dims);
+	alglib::kdtreequeryresultsx(kdt, result);
+
+	// return the size of neighbor set
+	return k;
+}
+
+alglib::ae_int_t getKNeighbors(const alglib::kdtree& kdt, alglib::kdtreerequestbuffer& buffer, alglib::real_2d_array& result, const alglib::real_1d_array& queryPoint, double radius)
+{
+	// query tree for a given point around a radius
+	alglib::ae_int_t k = alglib::kdtreetsqueryrnn(kdt, buffer, queryPoint, radius);
+
+	// the queried results are in the request buffer
+	result.setlength(k, constants::dims);
+	alglib::kdtreetsqueryresultsx(kdt, buffer, result);
+
+	// return the size of neighbor set
+	return k;
+}
+
+alglib::ae_int_t getKNeighborsTagged(alglib::kdtree& kdt, alglib::real_2d_array& result, alglib::integer_1d_array& tags, const alglib::real_1d_array& queryPoint, double radius)
+{
+	// query tree for a given point around a radius
+	alglib::ae_int_t k = alglib::kdtreequeryrnn(kdt, queryPoint, radius);
+
+	// the queried results are in an internal buffer of the tree
+	result.setlength(k, constants::dims);
+	tags.setlength(k);
+	
+	alglib::kdtreequeryresultsx(kdt, result);
+	alglib::kdtreequeryresultstags(kdt, tags);
+
+	std::cout << tags.tostring() << std::endl;
+
+	// return the size of neighbor set
+	return k;
+}
+
+
+double estimateRadius(const alglib::kdtree& kdt, const alglib::real_2d_array& points, size_t nPoints, size_t k, unsigned int nThreads)
+{
+	std::vector<double> meanDistances, kthDistances;
+	neighborDistances(kdt, points, nPoints, k, meanDistances, kthDistances, nThreads);
+	return radiusFromDistances(kthDistances);
+}
+
+
+void neighborDistances(const alglib::kdtree& kdt, const alglib::real_2d_array& points, size_t nPoints, size_t k,
+	std::vector<double>& meanDistances, std::vector<double>& kthDistances, unsigned int nThreads)
+{
+	meanDistances.resize(nPoints);
+	kthDistances.resize(nPoints);
+
+	parallelFor(nPoints, [&](size_t begin, size_t end, unsigned int)
+	{
+		alglib::kdtreerequestbuffer buffer;
+		alglib::kdtreecreaterequestbuffer(kdt, buffer);
+
+		alglib::real_1d_array queryPoint, distances;
+		for (size_t i = begin; i < end; i++)
+		{
+			queryPoint.setcontent(constants::dims, points[i]);
+
+			// the point itself is its first neighbor
+			alglib::ae_int_t found = alglib::kdtreetsqueryknn(kdt, buffer, queryPoint, alglib::ae_int_t(k), true);
+			alglib::kdtreetsqueryresultsdistances(kdt, buffer, distances);
+
+			double sum = 0;
+			for (alglib::ae_int_t j = 1; j < found; j++)
+				sum += distances[j];
+
+			meanDistances[i] = found > 1 ? sum / double(found - 1) : 0;
+			kthDistances[i] = found > 0 ? distances[found - 1] : 0;
+		}
+	}, nThreads);
+}
+
+
+double radiusFromDistances(std::vector<double>& kthDistances)
+{
+	if (kthDistances.empty())
+		return 0;
+
+	size_t middle = kthDistances.size() / 2;
+	std::nth_element(kthDistances.begin(), kthDistances.begin() + middle, kthDistances.end());
+	return kthDistances[middle];
+}
+
+
+size_t removeOutliers(alglib::real_2d_array& points, size_t nPoints, double deviations,
+	std::vector<double>& meanDistances, std::vector<double>& kthDistances, unsigned int nThreads)
+{
+	if (nPoints == 0)
+		return 0;
+
+	// in order, so the threshold doesn't depend on the number of threads
+	double mean = 0, squares = 0;
+	for (size_t i = 0; i < nPoints; i++)
+	{
+		mean += meanDistances[i];
+		squares += meanDistances[i] * meanDistances[i];
+	}
+	mean /= double(nPoints);
+	double sigma = std::sqrt(std::max(0.0, squares / double(nPoints) - mean * mean));
+	double threshold = mean + deviations * sigma;
+
+	// points kept by every chunk, then where each chunk writes them
+	std::vector<size_t> chunkKept(workerCount(nThreads) + 1, 0);
+	parallelFor(nPoints, [&](size_t begin, size_t end, unsigned int worker)
+	{
+		size_t kept = 0;
+		for (size_t i = begin; i < end; i++)
+			kept += meanDistances[i] <= threshold;
+		chunkKept[worker + 1] = kept;
+	}, nThreads);
+
+	for (size_t w = 1; w < chunkKept.size(); w++)
+		chunkKept[w] += chunkKept[w - 1];
+
+	size_t nKept = chunkKept.back();
+	if (nKept == nPoints)
+		return nPoints;
+
+	alglib::real_2d_array kept;
+	kept.setlength(nKept, constants::dims);
+	std::vector<double> keptMeans(nKept), keptKths(nKept);
+
+	parallelFor(nPoints, [&](size_t begin, size_t end, unsigned int worker)
+	{
+		size_t k = chunkKept[worker];
+		for (size_t i = begin; i < end; i++)
+			if (meanDistances[i] <= threshold)
+			{
+				for (size_t d = 0; d < constants::dims; d++)
+					kept[k][d] = points[i][d];
+				keptMeans[k] = meanDistances[i];
+				keptKths[k] = kthDistances[i];
+				k++;
+			}
+	}, nThreads);
+
+	points = kept;
+	meanDistances.swap(keptMeans);
+	kthDistances.swap(keptKths);
+	return nKept;
+}
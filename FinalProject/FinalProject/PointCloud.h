@@ -0,0 +1,341 @@
+#pragma once
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// tiny object loader
+#include "Libraries/tinyobj/tiny_obj_loader.h"
+
+// alglib nearest neighbor subpackage for kdtree
+#include "Libraries/alglib/alglibmisc.h"
+
+#include "PointArrays.h"
+
+
+namespace constants
+{
+	const unsigned int kdtTreeNormType = 2; // 2-norm (Euclidean-norm)
+	const unsigned int dims = 3; // dimensions
+	const unsigned int psd = 6; // precision display, used on displaying alglib f-values
+}
+
+
+/*
+	loadCloud
+
+		Wraps the process of loading the cloud point
+		by reading vertices from the OBJ file using
+		tinyobj loader.
+
+		See loadPoints for the other formats.
+*/
+
+bool loadCloud(tinyobj::attrib_t& attrib, const std::string& filename);
+
+
+/*
+	CloudFormat
+
+		Point cloud file formats the pipeline reads.
+*/
+
+enum CloudFormat
+{
+	FORMAT_UNKNOWN,
+	FORMAT_OBJ,		// wavefront, only the v lines are used
+	FORMAT_XYZ,		// one point per line, x y z and optional extra columns
+	FORMAT_PLY		// binary PLY, vertex x y z and optional nx ny nz and intensity
+};
+
+
+/*
+	detectCloudFormat
+
+		From the extension (.obj, .xyz, .pts, .txt,
+		.ply) or else from the first line that is
+		not a comment: "ply" is PLY, "v ..." is OBJ,
+		a line of numbers is XYZ. FORMAT_UNKNOWN if the file can't be
+		read or matches neither.
+*/
+
+CloudFormat detectCloudFormat(const std::string& filename);
+
+
+/*
+	loadXyz
+
+		Reads the first three columns of every line
+		of an XYZ file, skipping blank lines and #
+		comments. Extra columns (normals, colors) are
+		ignored.
+*/
+
+bool loadXyz(const std::string& filename, alglib::real_2d_array& points, size_t& nPoints);
+
+
+/*
+	loadPly
+
+		Reads the vertex element of a binary (little
+		or big endian) PLY file. The body is mapped
+		and decoded in place straight into the
+		arrays: x y z into points, nx ny nz into
+		normals and intensity (or scalar_intensity)
+		into intensity when asked for, left empty
+		when the file doesn't have them. Properties
+		can be of any scalar type and order, other
+		properties and elements are skipped, but
+		only the vertex element may hold lists.
+*/
+
+bool loadPly(const std::string& filename, alglib::real_2d_array& points, size_t& nPoints, alglib::real_2d_array *normals = NULL, alglib::real_1d_array *intensity = NULL);
+
+
+/*
+	loadPoints
+
+		Loads a cloud in any supported format into
+		an alglib array, detecting the format unless
+		given.
+*/
+
+bool loadPoints(const std::string& filename, alglib::real_2d_array& points, size_t& nPoints, CloudFormat format = FORMAT_UNKNOWN);
+
+
+/*
+	PointStream
+
+		Reads a cloud a block of points at a time
+		without ever holding all of it, for clouds
+		larger than memory: OBJ v lines and XYZ
+		lines through a buffered stream, PLY
+		decoded from the mapped body.
+*/
+
+class PointStream
+{
+public:
+	PointStream();
+	~PointStream();
+
+	bool open(const std::string& filename, CloudFormat format = FORMAT_UNKNOWN);
+
+	// up to maxPoints points as interleaved x y z, 0 at the end of the cloud
+	size_t read(double *xyz, size_t maxPoints);
+
+	// the stream ended on a malformed line or a truncated body
+	bool failed() const;
+
+private:
+	struct Impl;
+	std::unique_ptr<Impl> impl;
+
+	PointStream(const PointStream&);
+	PointStream& operator=(const PointStream&);
+};
+
+
+/*
+	OrientedCloudWriter
+
+		Writes points with their normals a block at
+		a time, as saveOrientedCloud does, when they
+		don't all fit in memory. The number of
+		points goes in the PLY header, so it must be
+		known when opening; close() fails if a
+		different number was written.
+*/
+
+class OrientedCloudWriter
+{
+public:
+	OrientedCloudWriter();
+	~OrientedCloudWriter();
+
+	bool open(const std::string& filename, size_t nPoints, CloudFormat format = FORMAT_UNKNOWN, unsigned int nThreads = 0);
+
+	// interleaved x y z and nx ny nz
+	bool write(const double *xyz, const double *normals, size_t count);
+
+	bool close();
+
+private:
+	std::ofstream out;
+	CloudFormat format;
+	unsigned int nThreads;
+	size_t nPoints;
+	size_t nWritten;
+	std::vector<float> floats;
+	std::vector<std::string> text;
+
+	OrientedCloudWriter(const OrientedCloudWriter&);
+	OrientedCloudWriter& operator=(const OrientedCloudWriter&);
+};
+
+
+/*
+	saveOrientedCloud
+
+		Writes the points with their normals, once
+		propagated, for tools downstream of the
+		pipeline:
+
+		- FORMAT_PLY: binary little endian PLY with
+		  float x y z nx ny nz vertex properties
+		- FORMAT_XYZ: "x y z nx ny nz" lines
+
+		Both are written in large blocks, the XYZ
+		text of a block formatted by nThreads
+		workers (0 for one per hardware thread).
+		The format is taken from the extension
+		unless given. Points and normals are read
+		through views, so either can be an alglib
+		matrix or a Vec3Arrays.
+*/
+
+bool saveOrientedCloud(const std::string& filename, const Vec3View& points, const Vec3View& normals, CloudFormat format = FORMAT_UNKNOWN, unsigned int nThreads = 0);
+
+
+/*
+	adaptDataPoints
+
+		The input OBJ file is stored with
+		float precisition but ALGLIB uses
+		double for its R1 representations.
+		
+		Casting the values is ok but casting
+		pointers generates missalignment.
+		
+		We could also set TINYOBJLOADER_USE_DOUBLE 
+		to change the real_t type of tinyobj,
+		however, this introduces problems
+		when reading the files.
+*/
+
+alglib::real_2d_array& adaptDataPoints(const std::vector<tinyobj::real_t>& vertices, const size_t numberOfVertices, alglib::real_2d_array& points);
+
+
+/*
+	buildKDTree
+
+		Build a constants::dims dimensional kdtree
+		of the cloud point using norm2 
+		(euclidean distance), with alglib given
+		nThreads workers (see alglibThreading).
+*/
+
+alglib::kdtree& buildKDTree(alglib::kdtree& kdt, const alglib::real_2d_array& points, const alglib::ae_int_t n, unsigned int nThreads = 1);
+
+alglib::kdtree& buildTaggedKDTree(alglib::kdtree& kdt, const alglib::real_2d_array& points, const alglib::integer_1d_array& tags, const alglib::ae_int_t n,
+	unsigned int nThreads = 1);
+
+
+/*
+	VoxelReduction
+
+		What a cell of voxelDownsample keeps.
+*/
+
+enum VoxelReduction
+{
+	VOXEL_CENTROID,		// the mean of its points
+	VOXEL_POINT			// its point closest to that mean, an actual sample
+};
+
+
+/*
+	voxelDownsample
+
+		One point per occupied cell of a grid of
+		edge voxelSize, for clouds much denser than
+		the neighborhood radius needs. The points
+		are hashed by cell on nThreads workers (0
+		for one per hardware thread), and the cells
+		are kept in the order of their first point
+		and reduced in input order, so the samples
+		don't depend on the number of threads.
+
+		Returns the number of samples.
+*/
+
+size_t voxelDownsample(const alglib::real_2d_array& points, size_t nPoints, double voxelSize, VoxelReduction reduction,
+	alglib::real_2d_array& samples, unsigned int nThreads = 0);
+
+
+/*
+	getKNeighbors
+
+		get k neighbors on a given radius of the query point
+		(returns self if only point in the k-neighborhood)
+*/
+
+alglib::ae_int_t getKNeighbors(alglib::kdtree& kdt, alglib::real_2d_array& result, const alglib::real_1d_array& queryPoint, double radius);
+
+
+/*
+	getKNeighbors
+
+		same as above, but the query state lives in
+		a request buffer so several threads can
+		query the same tree
+*/
+
+alglib::ae_int_t getKNeighbors(const alglib::kdtree& kdt, alglib::kdtreerequestbuffer& buffer, alglib::real_2d_array& result, const alglib::real_1d_array& queryPoint, double radius);
+
+
+/*
+	getKNeighborsTagged
+
+		get k neighbors on a given radius of the query point
+		(returns self if only point in the k-neighborhood)
+		includes tags
+*/
+
+alglib::ae_int_t getKNeighborsTagged(alglib::kdtree& kdt, alglib::real_2d_array& result, alglib::integer_1d_array& tags, const alglib::real_1d_array& queryPoint, double radius);
+
+
+/*
+	estimateRadius
+
+		Neighborhood radius from the density of the
+		cloud: the median distance from the points
+		to their k-th nearest neighbor, so that a
+		radius query returns about k points whatever
+		the units of the scan.
+*/
+
+double estimateRadius(const alglib::kdtree& kdt, const alglib::real_2d_array& points, size_t nPoints, size_t k, unsigned int nThreads = 0);
+
+
+/*
+	neighborDistances
+
+		The k nearest neighbors of every point, the
+		point itself being the first: the mean
+		distance to the others and the distance to
+		the k-th. One query serves both the outlier
+		removal and the radius estimation.
+*/
+
+void neighborDistances(const alglib::kdtree& kdt, const alglib::real_2d_array& points, size_t nPoints, size_t k,
+	std::vector<double>& meanDistances, std::vector<double>& kthDistances, unsigned int nThreads = 0);
+
+
+// the median of the k-th neighbor distances, reorders them
+double radiusFromDistances(std::vector<double>& kthDistances);
+
+
+/*
+	removeOutliers
+
+		Statistical outlier removal: drops the points
+		whose mean neighbor distance is beyond
+		mu + deviations * sigma of all of them, and
+		compacts the points and both distances in
+		order. Returns the number of points kept.
+*/
+
+size_t removeOutliers(alglib::real_2d_array& points, size_t nPoints, double deviations,
+	std::vector<double>& meanDistances, std::vector<double>& kthDistances, unsigned int nThreads = 0);
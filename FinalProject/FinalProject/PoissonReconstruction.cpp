@@ -0,0 +1,264 @@
+#include "PoissonReconstruction.h"
+
+#include <cmath>
+#include <vector>
+
+#include "Libraries/alglib/fasttransforms.h"
+
+#include "AlglibArena.h"
+#include "Parallel.h"
+
+
+namespace
+{
+	const double pi = 3.14159265358979323846;
+
+	// FFT sizes with only 2, 3 and 5 as factors
+	size_t fftSize(size_t n)
+	{
+		for (;; n++)
+		{
+			size_t m = n;
+			while (m % 2 == 0) m /= 2;
+			while (m % 3 == 0) m /= 3;
+			while (m % 5 == 0) m /= 5;
+			if (m == 1)
+				return n;
+		}
+	}
+
+	/*
+		trilinearStencil
+
+			Lower corner node and weights of the cell
+			containing the point at grid coordinates u.
+			False when the cell is outside the grid.
+	*/
+
+	bool trilinearStencil(const ScalarGrid& grid, const double *u, size_t& node, double *t)
+	{
+		size_t cell[3];
+		for (size_t d = 0; d < 3; d++)
+		{
+			double c = std::floor(u[d]);
+			if (c < 0 || c + 1 >= double(grid.dims[d]))
+				return false;
+
+			cell[d] = size_t(c);
+			t[d] = u[d] - c;
+		}
+
+		node = grid.index(cell[0], cell[1], cell[2]);
+		return true;
+	}
+
+	double cornerWeight(const double *t, int corner)
+	{
+		return (corner & 1 ? t[0] : 1 - t[0])
+			* (corner & 2 ? t[1] : 1 - t[1])
+			* (corner & 4 ? t[2] : 1 - t[2]);
+	}
+
+	size_t cornerOffset(const ScalarGrid& grid, int corner)
+	{
+		return (corner & 1 ? 1 : 0)
+			+ (corner & 2 ? grid.dims[0] : 0)
+			+ (corner & 4 ? grid.dims[0] * grid.dims[1] : 0);
+	}
+
+	/*
+		splatNormals
+
+			Trilinear splat of the normals, component d
+			on a grid shifted by half a cell along d so
+			that the forward difference of chi at a node
+			matches the field stored there. One component
+			per worker.
+	*/
+
+	void splatNormals(
+		const ScalarGrid& grid,
+		const Vec3Arrays& points,
+		const Vec3Arrays& normals,
+		std::vector<double> *field,
+		unsigned int nThreads)
+	{
+		parallelFor(3, [&](size_t begin, size_t end, unsigned int)
+		{
+			for (size_t d = begin; d < end; d++)
+			{
+				field[d].assign(grid.nNodes(), 0.0);
+
+				for (size_t i = 0; i < points.size(); i++)
+				{
+					double u[3], t[3];
+					for (size_t k = 0; k < 3; k++)
+						u[k] = (points(i, k) - grid.origin[k]) / grid.cellSize;
+					u[d] -= 0.5;
+
+					size_t node;
+					if (!trilinearStencil(grid, u, node, t))
+						continue;
+
+					for (int c = 0; c < 8; c++)
+						field[d][node + cornerOffset(grid, c)] += cornerWeight(t, c) * normals(i, d);
+				}
+			}
+		}, nThreads);
+	}
+
+	/*
+		transformAxis
+
+			In place 1-D FFT of every grid line along
+			the axis, lines split among the workers.
+			The inverse transform includes the 1 / n.
+			alglib plans every transform anew, each
+			worker keeps the plans in its arena.
+	*/
+
+	void transformAxis(std::vector<alglib::complex>& data, const size_t *dims, size_t axis, bool inverse, unsigned int nThreads)
+	{
+		size_t n = dims[axis];
+		size_t stride = axis == 0 ? 1 : axis == 1 ? dims[0] : dims[0] * dims[1];
+		size_t nLines = data.size() / n;
+
+		parallelFor(nLines, [&](size_t begin, size_t end, unsigned int)
+		{
+			AlglibArena arena;
+			AlglibArenaScope scope(arena);
+
+			alglib::complex_1d_array line;
+			line.setlength(n);
+
+			for (size_t l = begin; l < end; l++)
+			{
+				size_t first = l % stride + (l / stride) * stride * n;
+
+				alglib::complex *values = line.getcontent();
+				for (size_t i = 0; i < n; i++)
+					values[i] = data[first + i * stride];
+
+				if (inverse)
+					alglib::fftc1dinv(line, n);
+				else
+					alglib::fftc1d(line, n);
+
+				values = line.getcontent();
+				for (size_t i = 0; i < n; i++)
+					data[first + i * stride] = values[i];
+			}
+		}, nThreads);
+	}
+
+	void transform(std::vector<alglib::complex>& data, const size_t *dims, bool inverse, unsigned int nThreads)
+	{
+		for (size_t axis = 0; axis < 3; axis++)
+			transformAxis(data, dims, axis, inverse, nThreads);
+	}
+}
+
+
+void samplePoissonIndicator(
+	ScalarGrid& grid,
+	const Vec3Arrays& points,
+	const Vec3Arrays& normals,
+	double screening,
+	unsigned int nThreads)
+{
+	// grow to sizes the FFT handles without large prime factors
+	for (size_t d = 0; d < 3; d++)
+		grid.dims[d] = fftSize(grid.dims[d]);
+
+	size_t nNodes = grid.nNodes();
+	double h = grid.cellSize;
+
+	std::vector<double> field[3];
+	splatNormals(grid, points, normals, field, nThreads);
+
+	// backward difference divergence, the adjoint of the forward gradient
+	size_t strides[3] = { 1, grid.dims[0], grid.dims[0] * grid.dims[1] };
+
+	std::vector<alglib::complex> spectrum(nNodes);
+	parallelFor(nNodes, [&](size_t begin, size_t end, unsigned int)
+	{
+		for (size_t node = begin; node < end; node++)
+		{
+			double divergence = 0;
+			for (size_t d = 0; d < 3; d++)
+			{
+				// periodic wrap on the first node of the line
+				size_t coordinate = node / strides[d] % grid.dims[d];
+				size_t previous = coordinate > 0 ? node - strides[d] : node + (grid.dims[d] - 1) * strides[d];
+				divergence += (field[d][node] - field[d][previous]) / h;
+			}
+			spectrum[node] = alglib::complex(divergence, 0);
+		}
+	}, nThreads);
+
+	for (size_t d = 0; d < 3; d++)
+		std::vector<double>().swap(field[d]);
+
+	transform(spectrum, grid.dims, false, nThreads);
+
+	// eigenvalues of the 7-point laplacian along every axis
+	std::vector<double> eigenvalues[3];
+	for (size_t d = 0; d < 3; d++)
+	{
+		eigenvalues[d].resize(grid.dims[d]);
+		for (size_t k = 0; k < grid.dims[d]; k++)
+			eigenvalues[d][k] = (2 * std::cos(2 * pi * k / grid.dims[d]) - 2) / (h * h);
+	}
+
+	double shift = screening / (h * h);
+
+	parallelFor(nNodes, [&](size_t begin, size_t end, unsigned int)
+	{
+		for (size_t node = begin; node < end; node++)
+		{
+			size_t x = node % grid.dims[0];
+			size_t y = node / strides[1] % grid.dims[1];
+			size_t z = node / strides[2];
+
+			double lambda = eigenvalues[0][x] + eigenvalues[1][y] + eigenvalues[2][z] - shift;
+
+			// without screening the constant term is free, pin it to zero
+			if (lambda == 0)
+				spectrum[node] = alglib::complex(0, 0);
+			else
+				spectrum[node] = spectrum[node] / lambda;
+		}
+	}, nThreads);
+
+	transform(spectrum, grid.dims, true, nThreads);
+
+	grid.values.resize(nNodes);
+	for (size_t node = 0; node < nNodes; node++)
+		grid.values[node] = spectrum[node].x;
+
+	std::vector<alglib::complex>().swap(spectrum);
+
+	// iso-value, the average indicator at the samples
+	double iso = 0;
+	size_t nInside = 0;
+	for (size_t i = 0; i < points.size(); i++)
+	{
+		double u[3], t[3];
+		for (size_t k = 0; k < 3; k++)
+			u[k] = (points(i, k) - grid.origin[k]) / h;
+
+		size_t node;
+		if (!trilinearStencil(grid, u, node, t))
+			continue;
+
+		for (int c = 0; c < 8; c++)
+			iso += cornerWeight(t, c) * grid.values[node + cornerOffset(grid, c)];
+		nInside++;
+	}
+
+	if (nInside > 0)
+		iso /= nInside;
+
+	for (size_t node = 0; node < nNodes; node++)
+		grid.values[node] -= iso;
+}
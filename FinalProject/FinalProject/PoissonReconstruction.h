@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Libraries/alglib/ap.h"
+
+#include "Contouring.h"
+
+
+namespace constants
+{
+	const size_t poissonMargin = 8; // empty cells around the cloud, keeps the periodic copies of the solution apart
+	const double poissonScreening = 1e-3; // screening weight, in units of 1 / cellSize^2
+}
+
+
+/*
+	samplePoissonIndicator
+
+		Kazhdan's Poisson reconstruction on a
+		regular grid: the oriented normals are
+		splatted into a vector field V and the
+		indicator function chi solving
+
+			(laplacian - screening) chi = div V
+
+		is found spectrally. The divergence and the
+		7-point laplacian are discretized with the
+		same differences, so the equation is diagonal
+		in the Fourier basis of the periodic grid and
+		a single forward and inverse 3-D FFT (alglib's
+		fftc1d along the lines of every axis) solve it.
+
+		The grid is grown to FFT friendly sizes and
+		filled with chi minus its mean value at the
+		points, so like the signed distance it is
+		positive outside and its zero set is the
+		surface. Expects the grid from initGrid with
+		a margin of at least poissonMargin.
+*/
+
+void samplePoissonIndicator(
+	ScalarGrid& grid,
+	const Vec3Arrays& points,
+	const Vec3Arrays& normals,
+	double screening = constants::poissonScreening,
+	unsigned int nThreads = 0);
@@ -0,0 +1,130 @@
+#include "RbfReconstruction.h"
+
+#include <cmath>
+#include <vector>
+
+#include "Parallel.h"
+
+
+namespace
+{
+	const unsigned int offsetHalvings = 4; // tries before giving up on off-surface points of a centroid
+}
+
+
+alglib::ae_int_t buildImplicitRbf(
+	alglib::rbfmodel& model,
+	const alglib::kdtree& kdtCentroids,
+	const Vec3Arrays& centroids,
+	const Vec3Arrays& normals,
+	double offset,
+	double baseRadius,
+	unsigned int nThreads)
+{
+	size_t nPoints = centroids.size();
+
+	// rows 3i, 3i + 1, 3i + 2: the centroid and its outer and inner points
+	alglib::real_2d_array xy;
+	xy.setlength(3 * nPoints, 4);
+
+	std::vector<char> keep(nPoints, 1);
+
+	parallelFor(nPoints, [&](size_t begin, size_t end, unsigned int)
+	{
+		alglib::kdtreerequestbuffer buffer;
+		alglib::kdtreecreaterequestbuffer(kdtCentroids, buffer);
+
+		alglib::real_1d_array query;
+		alglib::integer_1d_array tags;
+		query.setlength(3);
+
+		for (size_t i = begin; i < end; i++)
+		{
+			for (size_t d = 0; d < 3; d++)
+				xy[3 * i][d] = centroids(i, d);
+			xy[3 * i][3] = 0;
+
+			// shrink the offset until both points project back onto c_i
+			double d = offset;
+			unsigned int tries = 0;
+			for (; tries <= offsetHalvings; tries++, d /= 2)
+			{
+				bool own = true;
+				for (int side = -1; side <= 1 && own; side += 2)
+				{
+					for (size_t k = 0; k < 3; k++)
+						query[k] = centroids(i, k) + side * d * normals(i, k);
+
+					alglib::kdtreetsqueryknn(kdtCentroids, buffer, query, 1);
+					alglib::kdtreetsqueryresultstags(kdtCentroids, buffer, tags);
+					own = size_t(tags[0]) == i;
+				}
+
+				if (own)
+					break;
+			}
+
+			if (tries > offsetHalvings)
+			{
+				keep[i] = 0;
+				continue;
+			}
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				xy[3 * i + 1][k] = centroids(i, k) + d * normals(i, k);
+				xy[3 * i + 2][k] = centroids(i, k) - d * normals(i, k);
+			}
+			xy[3 * i + 1][3] = d;
+			xy[3 * i + 2][3] = -d;
+		}
+	}, nThreads);
+
+	// drop the off-surface rows that could not be placed
+	size_t nRows = 0;
+	for (size_t i = 0; i < nPoints; i++)
+	{
+		size_t rows = keep[i] ? 3 : 1;
+		for (size_t r = 0; r < rows; r++, nRows++)
+			if (nRows != 3 * i + r)
+				for (size_t k = 0; k < 4; k++)
+					xy[nRows][k] = xy[3 * i + r][k];
+	}
+
+	alglib::rbfcreate(3, 1, model);
+	alglib::rbfsetpoints(model, xy, nRows);
+	alglib::rbfsetalgohierarchical(model, baseRadius, constants::rbfLayers, constants::rbfSmoothing);
+
+	alglib::rbfreport report;
+	alglib::rbfbuildmodel(model, report, alglibThreading(nThreads));
+
+	return report.terminationtype;
+}
+
+
+void sampleRbf(ScalarGrid& grid, const alglib::rbfmodel& model, unsigned int nThreads)
+{
+	parallelFor(grid.nNodes(), [&](size_t begin, size_t end, unsigned int)
+	{
+		// the model is read only, evaluation state lives in the buffer
+		alglib::rbfcalcbuffer buffer;
+		alglib::rbfcreatecalcbuffer(model, buffer);
+
+		alglib::real_1d_array x, y;
+		x.setlength(3);
+		y.setlength(1);
+
+		for (size_t node = begin; node < end; node++)
+		{
+			if (std::isnan(grid.values[node]))
+				continue;
+
+			x[0] = grid.origin[0] + grid.cellSize * (node % grid.dims[0]);
+			x[1] = grid.origin[1] + grid.cellSize * (node / grid.dims[0] % grid.dims[1]);
+			x[2] = grid.origin[2] + grid.cellSize * (node / (grid.dims[0] * grid.dims[1]));
+
+			alglib::rbftscalcbuf(model, buffer, x, y);
+			grid.values[node] = y[0];
+		}
+	}, nThreads);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Libraries/alglib/alglibmisc.h"
+#include "Libraries/alglib/interpolation.h"
+
+#include "Contouring.h"
+
+
+namespace constants
+{
+	const unsigned int rbfLayers = 5; // hierarchical RBF layers, the radius halves at every layer
+	const double rbfSmoothing = 0.0; // nonlinearity penalty of the hierarchical RBF, 0 interpolates
+}
+
+
+/*
+	buildImplicitRbf
+
+		Carr's RBF implicit surface: the model
+		interpolates 0 on the centroids and +d / -d
+		on the off-surface points c_i +- d n_i, so it
+		is positive outside like the signed distance.
+
+		The offset d starts at offset and is halved
+		for every centroid whose off-surface points
+		would be closer to another centroid, so the
+		constraints never cross a thin part of the
+		surface. The constraints are generated in
+		parallel.
+
+		Fits alglib's hierarchical RBF starting at
+		radius baseRadius. Returns the termination
+		type of rbfbuildmodel, 1 on success.
+*/
+
+alglib::ae_int_t buildImplicitRbf(
+	alglib::rbfmodel& model,
+	const alglib::kdtree& kdtCentroids,
+	const Vec3Arrays& centroids,
+	const Vec3Arrays& normals,
+	double offset,
+	double baseRadius,
+	unsigned int nThreads = 0);
+
+
+/*
+	sampleRbf
+
+		Evaluates the model on every defined grid
+		node, nodes already marked undefined (see
+		trimGrid) are skipped. The model is shared
+		and every worker evaluates it through its
+		own rbfcalcbuffer.
+*/
+
+void sampleRbf(ScalarGrid& grid, const alglib::rbfmodel& model, unsigned int nThreads = 0);
@@ -0,0 +1,703 @@
+#include "Reconstructor.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "CloudCache.h"
+#include "Decimation.h"
+#include "MeshOptimization.h"
+#include "NormalEstimation.h"
+#include "PointCloud.h"
+#include "PoissonReconstruction.h"
+#include "RbfReconstruction.h"
+
+
+/*
+	Reconstructor::State
+
+		Everything a reconstructor owns, behind a
+		pointer so moving one never copies the
+		alglib arrays.
+*/
+
+struct Reconstructor::State
+{
+	ReconstructionParameters parameters;
+	StageProfiler *profiler;
+	TraceRecorder *trace;
+	std::ostream *log;
+	std::ostream *planesLog;
+
+	bool completed[STAGE_COUNT];
+
+	size_t nPoints;
+	alglib::real_2d_array points;
+
+	bool reduced;						// points are derived from inputPoints: downsampled and/or filtered
+	size_t nInputPoints;
+	alglib::real_2d_array inputPoints;
+	bool outliersRemoved;
+
+	bool indexBuilt;					// the kdtree outlives radius changes
+	alglib::kdtree kdt;
+	double radius;
+
+	Vec3Arrays centroids;
+	Vec3Arrays normals;
+
+	alglib::kdtree kdtCentroids;
+	RiemannianGraph graph;
+
+	std::vector<size_t> mst;
+	size_t mstRoot;
+
+	ScalarGrid grid;
+	TriangleMesh mesh;
+	SubdivisionSurface surface;
+
+	State(const ReconstructionParameters& p)
+		: parameters(p), profiler(NULL), trace(NULL), log(NULL), planesLog(NULL), nPoints(0), reduced(false), nInputPoints(0), outliersRemoved(false), indexBuilt(false), radius(0),
+		mstRoot(0)
+	{
+		std::fill(completed, completed + STAGE_COUNT, false);
+	}
+
+	// stages are only recorded with a profiler attached
+	void begin(const std::string& name)
+	{
+		if (profiler)
+			profiler->begin(name);
+	}
+
+	void count(const std::string& counter, size_t value)
+	{
+		if (profiler)
+			profiler->count(counter, value);
+	}
+
+	void end()
+	{
+		if (profiler)
+			profiler->end();
+	}
+};
+
+
+Reconstructor::Reconstructor(const ReconstructionParameters& parameters)
+	: state(new State(parameters))
+{
+}
+
+Reconstructor::~Reconstructor()
+{
+}
+
+Reconstructor::Reconstructor(Reconstructor&& other)
+	: state(std::move(other.state))
+{
+}
+
+Reconstructor& Reconstructor::operator=(Reconstructor&& other)
+{
+	state = std::move(other.state);
+	return *this;
+}
+
+
+const ReconstructionParameters& Reconstructor::parameters() const
+{
+	return state->parameters;
+}
+
+void Reconstructor::setParameters(const ReconstructionParameters& p)
+{
+	const ReconstructionParameters& old = state->parameters;
+
+	// the earliest stage the change affects
+	ReconstructionStage stage = STAGE_COUNT;
+	// the outliers are removed from the downsampled points, so both start over from the input
+	if (p.voxelSize != old.voxelSize || (p.voxelSize > 0 && p.voxelReduction != old.voxelReduction)
+		|| p.outlierDeviations != old.outlierDeviations || (p.outlierDeviations > 0 && p.radiusNeighbors != old.radiusNeighbors))
+		stage = STAGE_DOWNSAMPLING;
+	else if (p.radius != old.radius || (p.radius <= 0 && p.radiusNeighbors != old.radiusNeighbors))
+		stage = STAGE_INDEX;
+	else if (p.implicitFunction != old.implicitFunction || p.cellSize != old.cellSize)
+		stage = STAGE_IMPLICIT;
+	else if (p.decimation != old.decimation || p.targetFaces != old.targetFaces || p.maxCollapseError != old.maxCollapseError
+		|| p.optimization != old.optimization || p.spring != old.spring || p.optimizationIterations != old.optimizationIterations)
+		stage = STAGE_CONTOUR; // the mesh stages edit the mesh in place
+	else if (p.subdivision != old.subdivision || p.controlFaces != old.controlFaces
+		|| p.subdivisionLevels != old.subdivisionLevels || p.fittingIterations != old.fittingIterations
+		|| p.spring != old.spring)
+		stage = STAGE_SUBDIVISION;
+
+	state->parameters = p;
+
+	if (stage != STAGE_COUNT)
+		invalidate(stage);
+}
+
+
+void Reconstructor::attachProfiler(StageProfiler *profiler)
+{
+	state->profiler = profiler;
+}
+
+void Reconstructor::attachTrace(TraceRecorder *trace)
+{
+	state->trace = trace;
+}
+
+void Reconstructor::attachLog(std::ostream *log)
+{
+	state->log = log;
+}
+
+void Reconstructor::attachPlanesLog(std::ostream *log)
+{
+	state->planesLog = log;
+}
+
+
+bool Reconstructor::loadCloud(const std::string& filename, CloudFormat format)
+{
+	invalidate(STAGE_POINTS);
+	state->indexBuilt = false;
+	state->reduced = false;
+
+	state->begin("load");
+
+	if (!loadPoints(filename, state->points, state->nPoints, format))
+	{
+		state->end();
+		return false;
+	}
+
+	state->count("points", state->nPoints);
+	state->end();
+
+	state->completed[STAGE_POINTS] = true;
+	return true;
+}
+
+bool Reconstructor::loadCache(const std::string& filename, uint64_t key)
+{
+	invalidate(STAGE_POINTS);
+	state->indexBuilt = false;
+	state->reduced = false;
+
+	state->begin("load cache");
+
+	bool hasIndex;
+	if (!loadCloudCache(filename, key, state->points, state->nPoints, &state->kdt, hasIndex))
+	{
+		state->end();
+		return false;
+	}
+
+	state->count("points", state->nPoints);
+	state->end();
+
+	state->indexBuilt = hasIndex;
+	state->completed[STAGE_POINTS] = true;
+	return true;
+}
+
+bool Reconstructor::saveCache(const std::string& filename, uint64_t key) const
+{
+	if (!state->completed[STAGE_POINTS])
+		return false;
+
+	state->begin("save cache");
+	state->count("points", nInputPoints());
+
+	// the kdtree of reduced points isn't the one of the cloud
+	bool saved = saveCloudCache(filename, key, inputPoints(), nInputPoints(),
+		state->indexBuilt && !state->reduced ? &state->kdt : NULL);
+
+	state->end();
+	return saved;
+}
+
+bool Reconstructor::indexBuilt() const
+{
+	return state->indexBuilt;
+}
+
+void Reconstructor::setPoints(const alglib::real_2d_array& points, size_t nPoints)
+{
+	invalidate(STAGE_POINTS);
+	state->indexBuilt = false;
+	state->reduced = false;
+
+	state->points = points;
+	state->nPoints = nPoints;
+	state->completed[STAGE_POINTS] = true;
+}
+
+
+size_t Reconstructor::downsample()
+{
+	require(STAGE_POINTS);
+	invalidate(STAGE_DOWNSAMPLING);
+
+	const ReconstructionParameters& p = state->parameters;
+	if (p.voxelSize > 0)
+	{
+		if (!state->reduced)
+		{
+			state->inputPoints = state->points;
+			state->nInputPoints = state->nPoints;
+			state->reduced = true;
+		}
+
+		state->begin("downsampling");
+		state->count("points", state->nInputPoints);
+
+		state->nPoints = voxelDownsample(state->inputPoints, state->nInputPoints, p.voxelSize, p.voxelReduction,
+			state->points, p.nThreads);
+		state->indexBuilt = false;
+
+		state->count("samples", state->nPoints);
+		state->end();
+	}
+	else if (state->reduced)
+	{
+		state->points = state->inputPoints;
+		state->nPoints = state->nInputPoints;
+		state->inputPoints = alglib::real_2d_array();
+		state->reduced = false;
+		state->indexBuilt = false;
+	}
+	state->outliersRemoved = false;
+
+	state->completed[STAGE_DOWNSAMPLING] = true;
+	return state->nPoints;
+}
+
+
+void Reconstructor::buildIndex()
+{
+	require(STAGE_DOWNSAMPLING);
+	invalidate(STAGE_INDEX);
+
+	if (!state->indexBuilt)
+	{
+		state->begin("kdtree");
+		state->count("points", state->nPoints);
+
+		buildKDTree(state->kdt, state->points, state->nPoints, state->parameters.nThreads);
+		state->indexBuilt = true;
+	}
+
+	const ReconstructionParameters& p = state->parameters;
+	bool filter = p.outlierDeviations > 0 && !state->outliersRemoved;
+
+	// one kNN query for both the outliers and the radius
+	std::vector<double> meanDistances, kthDistances;
+	if (filter || p.radius <= 0)
+	{
+		state->begin(filter ? "outliers" : "radius");
+		neighborDistances(state->kdt, state->points, state->nPoints, p.radiusNeighbors, meanDistances, kthDistances, p.nThreads);
+	}
+
+	if (filter)
+	{
+		if (!state->reduced)
+		{
+			state->inputPoints = state->points;
+			state->nInputPoints = state->nPoints;
+			state->reduced = true;
+		}
+
+		size_t nPoints = state->nPoints;
+		state->nPoints = removeOutliers(state->points, nPoints, p.outlierDeviations, meanDistances, kthDistances, p.nThreads);
+		state->outliersRemoved = true;
+		state->count("points", nPoints);
+		state->count("outliers", nPoints - state->nPoints);
+
+		// the kept points need their own kdtree
+		if (state->nPoints < nPoints)
+		{
+			state->begin("kdtree");
+			state->count("points", state->nPoints);
+
+			buildKDTree(state->kdt, state->points, state->nPoints, p.nThreads);
+		}
+	}
+
+	if (p.radius > 0)
+		state->radius = p.radius;
+	else if (!kthDistances.empty() || state->nPoints == 0)
+		state->radius = radiusFromDistances(kthDistances);
+	else
+	{
+		// the outliers went on an earlier run
+		state->begin("radius");
+		state->radius = estimateRadius(state->kdt, state->points, state->nPoints, p.radiusNeighbors, p.nThreads);
+	}
+
+	state->end();
+	state->completed[STAGE_INDEX] = true;
+}
+
+
+size_t Reconstructor::estimatePlanes()
+{
+	require(STAGE_INDEX);
+	invalidate(STAGE_PLANES);
+
+	state->begin("planes");
+	state->count("points", state->nPoints);
+
+	size_t totalNeighbors = ::estimatePlanes(state->kdt, state->points, state->nPoints, state->radius,
+		state->centroids, state->normals, state->parameters.nThreads, state->trace, state->planesLog);
+
+	state->count("neighbors", totalNeighbors);
+	state->end();
+
+	state->completed[STAGE_PLANES] = true;
+	return totalNeighbors;
+}
+
+
+size_t Reconstructor::buildGraph()
+{
+	require(STAGE_PLANES);
+	invalidate(STAGE_GRAPH);
+
+	state->begin("graph");
+	state->count("vertices", state->nPoints);
+
+	{
+		TraceSpan span(state->trace, "centroid kdtree", "phase");
+
+		// tags to centroid index
+		alglib::integer_1d_array tags;
+		tags.setlength(state->nPoints);
+		for (size_t i = 0; i < state->nPoints; i++)
+			tags[i] = i;
+
+		// alglib builds from rows, and copies them into the tree anyway
+		alglib::real_2d_array rows;
+		copyRows(state->centroids.view(), rows);
+		buildTaggedKDTree(state->kdtCentroids, rows, tags, state->nPoints, state->parameters.nThreads);
+	}
+
+	size_t nEdges = buildRiemannianGraph(state->kdtCentroids, state->centroids, state->normals, state->radius,
+		state->graph, state->parameters.nThreads);
+
+	state->count("edges", nEdges);
+	state->end();
+
+	state->completed[STAGE_GRAPH] = true;
+	return nEdges;
+}
+
+
+void Reconstructor::buildMst()
+{
+	require(STAGE_GRAPH);
+	invalidate(STAGE_MST);
+
+	state->begin("mst");
+	state->count("vertices", state->nPoints);
+
+	// the propagation starts at the root, so the tree is rooted there too
+	state->mstRoot = selectMstRoot(state->centroids);
+	state->mst.resize(state->nPoints);
+	if (state->nPoints > 0)
+		primMst(state->graph, &state->mst[0], state->mstRoot);
+
+	state->end();
+	state->completed[STAGE_MST] = true;
+}
+
+
+void Reconstructor::orientNormals()
+{
+	require(STAGE_MST);
+	invalidate(STAGE_ORIENTATION);
+
+	state->begin("propagation");
+	state->count("vertices", state->nPoints);
+
+	if (state->nPoints > 0)
+	{
+		// the topmost normal turned to z+, then propagate
+		size_t root = state->mstRoot;
+		if (state->normals(root, 2) < 0)
+			for (size_t d = 0; d < constants::dims; d++)
+				state->normals(root, d) *= -1;
+
+		propagateNormals(&state->mst[0], state->normals, root);
+	}
+
+	state->end();
+	state->completed[STAGE_ORIENTATION] = true;
+}
+
+
+bool Reconstructor::sampleImplicit()
+{
+	require(STAGE_ORIENTATION);
+	invalidate(STAGE_IMPLICIT);
+
+	state->begin("implicit");
+
+	const ReconstructionParameters& p = state->parameters;
+	double cell = cellSize();
+	bool succeeded = true;
+
+	if (p.implicitFunction == POISSON_INDICATOR)
+	{
+		initGrid(state->grid, state->centroids.view(), cell, constants::poissonMargin);
+		samplePoissonIndicator(state->grid, state->centroids, state->normals, constants::poissonScreening, p.nThreads);
+		trimGrid(state->grid, state->kdt, state->radius, p.nThreads);
+	}
+	else if (p.implicitFunction == RBF_INTERPOLANT)
+	{
+		alglib::rbfmodel rbf;
+		succeeded = buildImplicitRbf(rbf, state->kdtCentroids, state->centroids, state->normals, cell, state->radius, p.nThreads) == 1;
+
+		initGrid(state->grid, state->centroids.view(), cell);
+		if (succeeded)
+		{
+			// trim first, the model is only evaluated near the data
+			state->grid.values.assign(state->grid.nNodes(), 0.0);
+			trimGrid(state->grid, state->kdt, state->radius, p.nThreads);
+			sampleRbf(state->grid, rbf, p.nThreads);
+		}
+		else
+			state->grid.values.assign(state->grid.nNodes(), std::numeric_limits<double>::quiet_NaN());
+	}
+	else
+	{
+		initGrid(state->grid, viewRows(state->points, state->nPoints), cell);
+		sampleSignedDistance(state->grid, state->kdtCentroids, state->centroids, state->normals, state->kdt, state->radius, p.nThreads);
+	}
+
+	state->count("nodes", state->grid.nNodes());
+	state->end();
+
+	state->completed[STAGE_IMPLICIT] = succeeded;
+	return succeeded;
+}
+
+
+void Reconstructor::contour()
+{
+	require(STAGE_IMPLICIT);
+	invalidate(STAGE_CONTOUR);
+
+	state->begin("contour");
+
+	state->mesh = TriangleMesh();
+	contourGrid(state->grid, state->mesh);
+
+	state->count("vertices", state->mesh.nVertices());
+	state->count("faces", state->mesh.nFaces());
+	state->end();
+
+	state->completed[STAGE_CONTOUR] = true;
+}
+
+
+size_t Reconstructor::decimate()
+{
+	// the mesh stages edit the mesh in place, start over from the contour if they already did
+	if (state->completed[STAGE_DECIMATION] || state->completed[STAGE_OPTIMIZATION])
+		contour();
+
+	require(STAGE_CONTOUR);
+	invalidate(STAGE_DECIMATION);
+
+	size_t collapses = 0;
+	size_t target = targetFaces();
+
+	if (state->mesh.nFaces() > target)
+	{
+		state->begin("decimation");
+		state->count("input faces", state->mesh.nFaces());
+
+		collapses = decimateMesh(state->mesh, target, state->parameters.maxCollapseError);
+
+		state->count("collapses", collapses);
+		state->count("faces", state->mesh.nFaces());
+		state->end();
+	}
+
+	state->completed[STAGE_DECIMATION] = true;
+	return collapses;
+}
+
+
+double Reconstructor::optimize()
+{
+	// start over from the contour, decimated again if it was, when already optimized
+	if (state->completed[STAGE_OPTIMIZATION])
+	{
+		bool decimated = state->completed[STAGE_DECIMATION];
+		contour();
+		if (decimated)
+			decimate();
+	}
+
+	require(state->parameters.decimation ? STAGE_DECIMATION : STAGE_CONTOUR);
+	invalidate(STAGE_OPTIMIZATION);
+
+	double energy = 0;
+	if (state->mesh.nFaces() > 0)
+	{
+		state->begin("optimization");
+		state->count("points", state->nPoints);
+		state->count("faces", state->mesh.nFaces());
+
+		const ReconstructionParameters& p = state->parameters;
+		energy = optimizeMesh(state->mesh, state->points, state->nPoints, p.spring, p.optimizationIterations, p.nThreads, state->log);
+
+		state->end();
+	}
+
+	state->completed[STAGE_OPTIMIZATION] = true;
+	return energy;
+}
+
+
+double Reconstructor::fitSubdivision()
+{
+	const ReconstructionParameters& p = state->parameters;
+	require(p.optimization ? STAGE_OPTIMIZATION : p.decimation ? STAGE_DECIMATION : STAGE_CONTOUR);
+	invalidate(STAGE_SUBDIVISION);
+
+	double energy = 0;
+	state->surface = SubdivisionSurface();
+
+	if (state->mesh.nFaces() > 0)
+	{
+		state->begin("subdivision");
+
+		TriangleMesh control = state->mesh;
+		decimateMesh(control, controlFaces());
+
+		buildSubdivisionSurface(state->surface, control, p.subdivisionLevels, p.nThreads);
+		energy = fitSubdivisionSurface(state->surface, state->points, state->nPoints, p.spring, p.fittingIterations, p.nThreads, state->log);
+
+		state->count("control vertices", state->surface.control.nVertices());
+		state->count("faces", state->surface.refined.nFaces());
+		state->end();
+	}
+
+	state->completed[STAGE_SUBDIVISION] = true;
+	return energy;
+}
+
+
+bool Reconstructor::reconstruct()
+{
+	if (!state->completed[STAGE_POINTS])
+		return false;
+
+	// nothing to contour if the implicit function could not be built
+	require(STAGE_IMPLICIT);
+	if (!state->completed[STAGE_IMPLICIT])
+		return false;
+
+	require(STAGE_CONTOUR);
+
+	const ReconstructionParameters& p = state->parameters;
+	if (p.decimation)
+		require(STAGE_DECIMATION);
+	if (p.optimization)
+		require(STAGE_OPTIMIZATION);
+	if (p.subdivision)
+		require(STAGE_SUBDIVISION);
+
+	return true;
+}
+
+
+bool Reconstructor::completed(ReconstructionStage stage) const
+{
+	return state->completed[stage];
+}
+
+void Reconstructor::invalidate(ReconstructionStage stage)
+{
+	for (size_t s = stage; s < STAGE_COUNT; s++)
+		state->completed[s] = false;
+
+	if (stage <= STAGE_GRAPH)
+		state->graph.clear();
+}
+
+
+void Reconstructor::require(ReconstructionStage stage)
+{
+	if (!state->completed[stage])
+		run(stage);
+}
+
+void Reconstructor::run(ReconstructionStage stage)
+{
+	switch (stage)
+	{
+	case STAGE_POINTS:			break; // nothing to run, the caller must provide them
+	case STAGE_DOWNSAMPLING:	downsample(); break;
+	case STAGE_INDEX:			buildIndex(); break;
+	case STAGE_PLANES:			estimatePlanes(); break;
+	case STAGE_GRAPH:			buildGraph(); break;
+	case STAGE_MST:				buildMst(); break;
+	case STAGE_ORIENTATION:		orientNormals(); break;
+	case STAGE_IMPLICIT:		sampleImplicit(); break;
+	case STAGE_CONTOUR:			contour(); break;
+	case STAGE_DECIMATION:		decimate(); break;
+	case STAGE_OPTIMIZATION:	optimize(); break;
+	case STAGE_SUBDIVISION:		fitSubdivision(); break;
+	default:					break;
+	}
+}
+
+
+size_t Reconstructor::nInputPoints() const { return state->reduced ? state->nInputPoints : state->nPoints; }
+const alglib::real_2d_array& Reconstructor::inputPoints() const { return state->reduced ? state->inputPoints : state->points; }
+size_t Reconstructor::nPoints() const { return state->nPoints; }
+const alglib::real_2d_array& Reconstructor::points() const { return state->points; }
+const alglib::kdtree& Reconstructor::pointsIndex() const { return state->kdt; }
+double Reconstructor::radius() const { return state->radius; }
+
+double Reconstructor::cellSize() const
+{
+	return state->parameters.cellSize > 0 ? state->parameters.cellSize : state->radius / 2;
+}
+
+size_t Reconstructor::targetFaces() const
+{
+	return state->parameters.targetFaces > 0 ? state->parameters.targetFaces : 2 * state->nPoints;
+}
+
+size_t Reconstructor::controlFaces() const
+{
+	return state->parameters.controlFaces > 0 ? state->parameters.controlFaces : state->nPoints / 4;
+}
+
+const Vec3Arrays& Reconstructor::centroids() const { return state->centroids; }
+const Vec3Arrays& Reconstructor::normals() const { return state->normals; }
+
+void Reconstructor::inputNormals(Vec3Arrays& normals) const
+{
+	if (!state->reduced)
+	{
+		normals = state->normals;
+		return;
+	}
+
+	transferNormals(state->points, state->normals, state->nPoints, state->inputPoints, state->nInputPoints, normals,
+		state->parameters.nThreads);
+}
+const RiemannianGraph& Reconstructor::graph() const { return state->graph; }
+const std::vector<size_t>& Reconstructor::mst() const { return state->mst; }
+size_t Reconstructor::mstRoot() const { return state->mstRoot; }
+const ScalarGrid& Reconstructor::grid() const { return state->grid; }
+const TriangleMesh& Reconstructor::mesh() const { return state->mesh; }
+const SubdivisionSurface& Reconstructor::surface() const { return state->surface; }
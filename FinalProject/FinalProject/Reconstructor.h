@@ -0,0 +1,213 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Libraries/alglib/alglibmisc.h"
+
+#include "Contouring.h"
+#include "Instrumentation.h"
+#include "Mesh.h"
+#include "NormalEstimation.h"
+#include "PointCloud.h"
+#include "Subdivision.h"
+
+
+/*
+	ReconstructionParameters
+
+		Every setting of the pipeline. Zero sizes
+		and radii are derived from the cloud: the
+		radius from its density (see estimateRadius),
+		the cell size from the radius and the face
+		budgets from the number of points.
+*/
+
+struct ReconstructionParameters
+{
+	double voxelSize;					// downsampling grid, 0 to keep every point
+	VoxelReduction voxelReduction;		// what a cell of the grid keeps
+	double radius;						// neighborhood radius, 0 to estimate it
+	size_t radiusNeighbors;				// neighbors per radius query when estimating it, and of the outlier statistics
+	double outlierDeviations;			// drop the points whose mean neighbor distance is beyond mu + this * sigma, 0 to keep them
+	ImplicitFunction implicitFunction;	// backend to contour
+	double cellSize;					// grid resolution, 0 for radius / 2
+	bool decimation;					// collapse the contour down to targetFaces
+	size_t targetFaces;					// 0 for 2 * points
+	double maxCollapseError;			// quadric error bound, 0 for none
+	bool optimization;					// Hoppe's mesh optimization
+	double spring;						// spring constant, Hoppe's kappa
+	unsigned int optimizationIterations;
+	bool subdivision;					// fit a Loop subdivision surface
+	size_t controlFaces;				// control mesh face budget, 0 for points / 4
+	unsigned int subdivisionLevels;
+	unsigned int fittingIterations;
+	unsigned int nThreads;				// worker threads, 0 for one per hardware thread
+
+	ReconstructionParameters()
+		: voxelSize(0), voxelReduction(VOXEL_CENTROID), radius(0), radiusNeighbors(24), outlierDeviations(0), implicitFunction(SIGNED_DISTANCE), cellSize(0),
+		decimation(true), targetFaces(0), maxCollapseError(0),
+		optimization(true), spring(1e-2), optimizationIterations(3),
+		subdivision(true), controlFaces(0), subdivisionLevels(2), fittingIterations(2),
+		nThreads(0) {}
+};
+
+
+/*
+	ReconstructionStage
+
+		The stages of the pipeline, in order. A
+		stage needs the results of the ones before
+		it, except the mesh stages after CONTOUR,
+		which can be skipped.
+*/
+
+enum ReconstructionStage
+{
+	STAGE_POINTS,		// the cloud, loaded or given
+	STAGE_DOWNSAMPLING,	// one point per voxel, when asked for
+	STAGE_INDEX,		// outlier removal, kdtree of the points and the radius
+	STAGE_PLANES,		// centroids and unoriented normals
+	STAGE_GRAPH,		// kdtree of the centroids and Riemannian graph
+	STAGE_MST,			// minimum spanning tree of the graph
+	STAGE_ORIENTATION,	// normals propagated along the MST
+	STAGE_IMPLICIT,		// implicit function sampled on the grid
+	STAGE_CONTOUR,		// zero set of the grid
+	STAGE_DECIMATION,
+	STAGE_OPTIMIZATION,
+	STAGE_SUBDIVISION,
+	STAGE_COUNT
+};
+
+
+/*
+	Reconstructor
+
+		The reconstruction pipeline as a reusable
+		object: it owns the points, their kdtree,
+		the planes, the graph and every later
+		result, and has one method per stage.
+
+		Calling a stage runs the missing stages it
+		depends on, so reconstruct() or any single
+		stage can be asked for directly, and the
+		results of a stage stay available until an
+		earlier stage is run again or invalidated by
+		new parameters. setParameters() only drops
+		the stages the change affects: a long running
+		process can keep the kdtree of a cloud and
+		try several radii, backends or face budgets.
+
+		With a voxel size the later stages work on
+		the downsampled points, and with outlier
+		deviations the index stage drops the
+		outliers from them and indexes the rest; the
+		loaded points stay available as the input
+		points, and inputNormals() brings the normals
+		back to them.
+
+		The centroids and normals are structure of
+		arrays (see Vec3Arrays), the points alglib
+		matrices like the loaders give them.
+
+		The mesh stages after CONTOUR edit the mesh
+		in place and each one requires the earlier
+		ones the parameters enable: optimize() a
+		decimated mesh when decimation is on, and
+		fitSubdivision() the optimized one when
+		optimization is. contour() starts over from
+		the grid; running decimate() or optimize()
+		again starts over from it too, instead of
+		editing the mesh twice, and drops every
+		later stage.
+
+		Attach a StageProfiler and/or a TraceRecorder
+		to have the stages recorded, and logs for
+		debugging output. There is no global state,
+		reconstructors can run on different threads,
+		except the size of alglib's worker pool,
+		which the driver sets for the process (see
+		setAlglibWorkers).
+		They are move only, a moved-from
+		reconstructor can only be assigned or
+		destroyed.
+*/
+
+class Reconstructor
+{
+public:
+	explicit Reconstructor(const ReconstructionParameters& parameters = ReconstructionParameters());
+	~Reconstructor();
+
+	Reconstructor(Reconstructor&& other);
+	Reconstructor& operator=(Reconstructor&& other);
+
+	const ReconstructionParameters& parameters() const;
+	void setParameters(const ReconstructionParameters& parameters);
+
+	void attachProfiler(StageProfiler *profiler);
+	void attachTrace(TraceRecorder *trace);
+	void attachLog(std::ostream *log);			// energies of every optimization and fitting iteration
+	void attachPlanesLog(std::ostream *log);		// neighborhood, centroid and normal of every point, single threaded
+
+	// inputs, all drop every result
+	bool loadCloud(const std::string& filename, CloudFormat format = FORMAT_UNKNOWN);
+	void setPoints(const alglib::real_2d_array& points, size_t nPoints);
+	bool loadCache(const std::string& filename, uint64_t key);	// the points and their kdtree if cached, see CloudCache.h
+
+	// the input points and, once built and not reduced, their kdtree
+	bool saveCache(const std::string& filename, uint64_t key) const;
+
+	// stages, in order
+	size_t downsample();						// returns the number of points kept
+	void buildIndex();
+	size_t estimatePlanes();					// returns the total number of neighbors
+	size_t buildGraph();						// returns the number of edges
+	void buildMst();
+	void orientNormals();
+	bool sampleImplicit();						// false if the backend failed, the grid is then undefined (NaN) and the stage not completed
+	void contour();
+	size_t decimate();							// returns the number of collapses
+	double optimize();							// returns E_dist + E_spring
+	double fitSubdivision();					// returns E_dist + E_spring
+
+	// every stage the parameters enable, returns false without points or if the implicit function failed
+	bool reconstruct();
+
+	bool completed(ReconstructionStage stage) const;
+	void invalidate(ReconstructionStage stage);	// drops the stage and every later one
+	bool indexBuilt() const;					// the kdtree of the points, kept across radius changes
+
+	// results, valid once their stage has run
+	size_t nInputPoints() const;				// as loaded
+	const alglib::real_2d_array& inputPoints() const;
+	size_t nPoints() const;						// downsampled and without outliers, if asked to
+	const alglib::real_2d_array& points() const;
+	const alglib::kdtree& pointsIndex() const;
+	double radius() const;
+	double cellSize() const;
+	size_t targetFaces() const;
+	size_t controlFaces() const;
+	const Vec3Arrays& centroids() const;			// structure of arrays, like the normals
+	const Vec3Arrays& normals() const;
+	void inputNormals(Vec3Arrays& normals) const;	// of the nearest point kept, for every input point
+	const RiemannianGraph& graph() const;
+	const std::vector<size_t>& mst() const;		// parent of every centroid
+	size_t mstRoot() const;
+	const ScalarGrid& grid() const;
+	const TriangleMesh& mesh() const;
+	const SubdivisionSurface& surface() const;
+
+private:
+	struct State;
+	std::unique_ptr<State> state;
+
+	void require(ReconstructionStage stage);
+	void run(ReconstructionStage stage);
+
+	Reconstructor(const Reconstructor&);
+	Reconstructor& operator=(const Reconstructor&);
+};
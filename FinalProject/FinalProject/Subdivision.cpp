@@ -0,0 +1,489 @@
+#include "Subdivision.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <utility>
+
+#include "Libraries/alglib/linalg.h"
+
+#include "MeshOptimization.h"
+#include "Parallel.h"
+
+
+namespace
+{
+	const double pi = 3.14159265358979323846;
+
+	/*
+		LoopTopology
+
+			Edge and one-ring adjacency of a triangle
+			mesh, as needed by the Loop masks.
+	*/
+
+	struct LoopTopology
+	{
+		std::vector<size_t> edges;			// sorted (lo, hi) pairs
+		std::vector<size_t> edgeStart;		// first edge of every lo vertex
+		std::vector<size_t> opposite;		// 2 per edge
+		std::vector<unsigned char> edgeFaces;
+		std::vector<size_t> faceEdges;		// edge of (v_i, v_i+1), 3 per face
+
+		std::vector<size_t> ringStart, ring;	// one-ring neighbors
+		std::vector<size_t> creases;			// 2 crease neighbors per vertex
+		std::vector<unsigned char> creaseCount;
+
+		size_t edgeIndex(size_t a, size_t b) const
+		{
+			size_t lo = std::min(a, b), hi = std::max(a, b);
+			for (size_t e = edgeStart[lo]; e < edgeStart[lo + 1]; e++)
+				if (edges[e * 2 + 1] == hi)
+					return e;
+
+			return size_t(-1);
+		}
+
+		void build(const TriangleMesh& mesh)
+		{
+			size_t nVertices = mesh.nVertices();
+			size_t nFaces = mesh.nFaces();
+
+			edges = meshEdges(mesh);
+			size_t nEdges = edges.size() / 2;
+
+			edgeStart.assign(nVertices + 1, 0);
+			for (size_t e = 0; e < nEdges; e++)
+				edgeStart[edges[e * 2] + 1]++;
+			for (size_t v = 0; v < nVertices; v++)
+				edgeStart[v + 1] += edgeStart[v];
+
+			opposite.assign(nEdges * 2, 0);
+			edgeFaces.assign(nEdges, 0);
+			faceEdges.resize(nFaces * 3);
+
+			for (size_t f = 0; f < nFaces; f++)
+			{
+				const size_t *face = &mesh.faces[f * 3];
+				for (size_t i = 0; i < 3; i++)
+				{
+					size_t e = edgeIndex(face[i], face[(i + 1) % 3]);
+					faceEdges[f * 3 + i] = e;
+
+					if (edgeFaces[e] < 2)
+						opposite[e * 2 + edgeFaces[e]] = face[(i + 2) % 3];
+					if (edgeFaces[e] < 3)
+						edgeFaces[e]++;
+				}
+			}
+
+			ringStart.assign(nVertices + 1, 0);
+			for (size_t e = 0; e < nEdges; e++)
+			{
+				ringStart[edges[e * 2] + 1]++;
+				ringStart[edges[e * 2 + 1] + 1]++;
+			}
+			for (size_t v = 0; v < nVertices; v++)
+				ringStart[v + 1] += ringStart[v];
+
+			ring.resize(ringStart[nVertices]);
+			creases.assign(nVertices * 2, 0);
+			creaseCount.assign(nVertices, 0);
+
+			std::vector<size_t> fill(ringStart.begin(), ringStart.end() - 1);
+			for (size_t e = 0; e < nEdges; e++)
+			{
+				size_t a = edges[e * 2], b = edges[e * 2 + 1];
+				ring[fill[a]++] = b;
+				ring[fill[b]++] = a;
+
+				// open boundaries and non-manifold edges are creases
+				if (edgeFaces[e] != 2)
+				{
+					if (creaseCount[a] < 2)
+						creases[a * 2 + creaseCount[a]] = b;
+					if (creaseCount[b] < 2)
+						creases[b * 2 + creaseCount[b]] = a;
+					creaseCount[a] = (unsigned char)std::min(creaseCount[a] + 1, 3);
+					creaseCount[b] = (unsigned char)std::min(creaseCount[b] + 1, 3);
+				}
+			}
+		}
+	};
+
+	// appends a row, sorting its columns
+	void appendRow(SparseRows& op, std::vector<std::pair<size_t, double>>& row)
+	{
+		std::sort(row.begin(), row.end());
+		for (size_t i = 0; i < row.size(); i++)
+		{
+			op.columns.push_back(row[i].first);
+			op.weights.push_back(row[i].second);
+		}
+		op.rowStart.push_back(op.columns.size());
+	}
+
+	double loopBeta(size_t n)
+	{
+		double c = 3.0 / 8.0 + std::cos(2 * pi / n) / 4;
+		return (5.0 / 8.0 - c * c) / n;
+	}
+
+	// vertex mask, subdivision (limit = false) or limit position (limit = true)
+	void vertexRow(const LoopTopology& topology, size_t v, bool limit, std::vector<std::pair<size_t, double>>& row)
+	{
+		row.clear();
+		size_t n = topology.ringStart[v + 1] - topology.ringStart[v];
+
+		if (topology.creaseCount[v] == 2)
+		{
+			double side = limit ? 1.0 / 6.0 : 1.0 / 8.0;
+			row.push_back(std::make_pair(v, 1 - 2 * side));
+			row.push_back(std::make_pair(topology.creases[v * 2], side));
+			row.push_back(std::make_pair(topology.creases[v * 2 + 1], side));
+			return;
+		}
+
+		// corners and isolated vertices stay put
+		if (topology.creaseCount[v] != 0 || n == 0)
+		{
+			row.push_back(std::make_pair(v, 1.0));
+			return;
+		}
+
+		double beta = loopBeta(n);
+		double w = beta;
+		if (limit)
+			w = 1 / (3 / (8 * beta) + n);
+
+		row.push_back(std::make_pair(v, 1 - n * w));
+		for (size_t r = topology.ringStart[v]; r < topology.ringStart[v + 1]; r++)
+			row.push_back(std::make_pair(topology.ring[r], w));
+	}
+
+	void compose(const SparseRows& a, const SparseRows& b, size_t begin, size_t end, std::vector<double>& acc, std::vector<size_t>& touched, SparseRows& out)
+	{
+		out.rowStart.clear();
+		out.columns.clear();
+		out.weights.clear();
+
+		for (size_t i = begin; i < end; i++)
+		{
+			touched.clear();
+			for (size_t k = a.rowStart[i]; k < a.rowStart[i + 1]; k++)
+			{
+				size_t j = a.columns[k];
+				double w = a.weights[k];
+				for (size_t l = b.rowStart[j]; l < b.rowStart[j + 1]; l++)
+				{
+					size_t c = b.columns[l];
+					if (acc[c] == 0)
+						touched.push_back(c);
+					acc[c] += w * b.weights[l];
+				}
+			}
+
+			std::sort(touched.begin(), touched.end());
+			for (size_t t = 0; t < touched.size(); t++)
+			{
+				// weights that cancel out are dropped along with the zeros
+				if (acc[touched[t]] != 0)
+				{
+					out.columns.push_back(touched[t]);
+					out.weights.push_back(acc[touched[t]]);
+				}
+				acc[touched[t]] = 0;
+			}
+			out.rowStart.push_back(out.columns.size());
+		}
+	}
+}
+
+
+void multiplySparse(const SparseRows& a, const SparseRows& b, SparseRows& result, unsigned int nThreads)
+{
+	size_t nRows = a.nRows();
+	std::vector<SparseRows> chunks(workerCount(nThreads));
+
+	parallelFor(nRows, [&](size_t begin, size_t end, unsigned int worker)
+	{
+		std::vector<double> acc(b.nColumns, 0.0);
+		std::vector<size_t> touched;
+		compose(a, b, begin, end, acc, touched, chunks[worker]);
+	}, nThreads);
+
+	// stitch the chunks back in row order
+	result.nColumns = b.nColumns;
+	result.rowStart.assign(1, 0);
+	result.columns.clear();
+	result.weights.clear();
+
+	for (size_t w = 0; w < chunks.size(); w++)
+	{
+		size_t offset = result.columns.size();
+		for (size_t r = 0; r < chunks[w].rowStart.size(); r++)
+			result.rowStart.push_back(offset + chunks[w].rowStart[r]);
+
+		result.columns.insert(result.columns.end(), chunks[w].columns.begin(), chunks[w].columns.end());
+		result.weights.insert(result.weights.end(), chunks[w].weights.begin(), chunks[w].weights.end());
+	}
+}
+
+
+void applySparse(const SparseRows& op, const std::vector<double>& positions, std::vector<double>& result, unsigned int nThreads)
+{
+	result.assign(op.nRows() * 3, 0.0);
+
+	parallelFor(op.nRows(), [&](size_t begin, size_t end, unsigned int)
+	{
+		for (size_t i = begin; i < end; i++)
+			for (size_t k = op.rowStart[i]; k < op.rowStart[i + 1]; k++)
+			{
+				const double *p = &positions[op.columns[k] * 3];
+				double w = op.weights[k];
+				result[i * 3] += w * p[0];
+				result[i * 3 + 1] += w * p[1];
+				result[i * 3 + 2] += w * p[2];
+			}
+	}, nThreads);
+}
+
+
+void loopSubdivide(const TriangleMesh& mesh, TriangleMesh& refined, SparseRows& step)
+{
+	LoopTopology topology;
+	topology.build(mesh);
+
+	size_t nVertices = mesh.nVertices();
+	size_t nEdges = topology.edges.size() / 2;
+	size_t nFaces = mesh.nFaces();
+
+	step.nColumns = nVertices;
+	step.rowStart.assign(1, 0);
+	step.columns.clear();
+	step.weights.clear();
+
+	std::vector<std::pair<size_t, double>> row;
+	for (size_t v = 0; v < nVertices; v++)
+	{
+		vertexRow(topology, v, false, row);
+		appendRow(step, row);
+	}
+
+	for (size_t e = 0; e < nEdges; e++)
+	{
+		size_t a = topology.edges[e * 2], b = topology.edges[e * 2 + 1];
+
+		row.clear();
+		if (topology.edgeFaces[e] == 2)
+		{
+			row.push_back(std::make_pair(a, 3.0 / 8.0));
+			row.push_back(std::make_pair(b, 3.0 / 8.0));
+			row.push_back(std::make_pair(topology.opposite[e * 2], 1.0 / 8.0));
+			row.push_back(std::make_pair(topology.opposite[e * 2 + 1], 1.0 / 8.0));
+		}
+		else
+		{
+			row.push_back(std::make_pair(a, 0.5));
+			row.push_back(std::make_pair(b, 0.5));
+		}
+		appendRow(step, row);
+	}
+
+	// four children per face, corners first and the middle one last
+	refined.faces.resize(nFaces * 12);
+	for (size_t f = 0; f < nFaces; f++)
+	{
+		const size_t *face = &mesh.faces[f * 3];
+		size_t e01 = nVertices + topology.faceEdges[f * 3];
+		size_t e12 = nVertices + topology.faceEdges[f * 3 + 1];
+		size_t e20 = nVertices + topology.faceEdges[f * 3 + 2];
+
+		size_t children[12] = {
+			face[0], e01, e20,
+			face[1], e12, e01,
+			face[2], e20, e12,
+			e01, e12, e20
+		};
+		std::copy(children, children + 12, &refined.faces[f * 12]);
+	}
+
+	applySparse(step, mesh.vertices, refined.vertices);
+}
+
+
+void loopLimitOperator(const TriangleMesh& mesh, SparseRows& limit)
+{
+	LoopTopology topology;
+	topology.build(mesh);
+
+	limit.nColumns = mesh.nVertices();
+	limit.rowStart.assign(1, 0);
+	limit.columns.clear();
+	limit.weights.clear();
+
+	std::vector<std::pair<size_t, double>> row;
+	for (size_t v = 0; v < mesh.nVertices(); v++)
+	{
+		vertexRow(topology, v, true, row);
+		appendRow(limit, row);
+	}
+}
+
+
+void buildSubdivisionSurface(SubdivisionSurface& surface, const TriangleMesh& control, unsigned int levels, unsigned int nThreads)
+{
+	surface.control = control;
+	surface.levels = levels;
+
+	TriangleMesh current = control, next;
+	SparseRows total, step, product;
+
+	// identity, so zero levels only takes the limit
+	total.nColumns = control.nVertices();
+	total.rowStart.resize(control.nVertices() + 1);
+	total.columns.resize(control.nVertices());
+	total.weights.assign(control.nVertices(), 1.0);
+	for (size_t v = 0; v <= control.nVertices(); v++)
+		total.rowStart[v] = v;
+	for (size_t v = 0; v < control.nVertices(); v++)
+		total.columns[v] = v;
+
+	for (unsigned int l = 0; l < levels; l++)
+	{
+		loopSubdivide(current, next, step);
+		multiplySparse(step, total, product, nThreads);
+		std::swap(total, product);
+		std::swap(current, next);
+	}
+
+	loopLimitOperator(current, step);
+	multiplySparse(step, total, surface.limit, nThreads);
+
+	surface.refined.faces.swap(current.faces);
+	evaluateSubdivisionSurface(surface, nThreads);
+}
+
+
+void evaluateSubdivisionSurface(SubdivisionSurface& surface, unsigned int nThreads)
+{
+	applySparse(surface.limit, surface.control.vertices, surface.refined.vertices, nThreads);
+}
+
+
+double fitSubdivisionSurface(
+	SubdivisionSurface& surface,
+	const alglib::real_2d_array& points,
+	size_t nPoints,
+	double springConstant,
+	unsigned int iterations,
+	unsigned int nThreads,
+	std::ostream *log)
+{
+	TriangleMesh& control = surface.control;
+	const SparseRows& limit = surface.limit;
+
+	std::vector<size_t> edges = meshEdges(control);
+	size_t nControl = control.nVertices();
+	size_t nEdges = edges.size() / 2;
+	double spring = std::sqrt(springConstant);
+
+	MeshProjection projection;
+	projectPoints(surface.refined, points, nPoints, projection, nThreads);
+
+	for (unsigned int it = 0; it < iterations; it++)
+	{
+		// point rows: barycentric blend of the limit rows of the projected face
+		std::vector<SparseRows> chunks(workerCount(nThreads));
+
+		parallelFor(nPoints, [&](size_t begin, size_t end, unsigned int worker)
+		{
+			SparseRows blend;
+			blend.nColumns = limit.nRows();
+			blend.rowStart.assign(1, 0);
+			for (size_t i = begin; i < end; i++)
+			{
+				const size_t *face = &surface.refined.faces[projection.faces[i] * 3];
+				for (size_t j = 0; j < 3; j++)
+				{
+					blend.columns.push_back(face[j]);
+					blend.weights.push_back(projection.barycentric[i * 3 + j]);
+				}
+				blend.rowStart.push_back(blend.columns.size());
+			}
+
+			// rows of the chunk are numbered from 0
+			std::vector<double> acc(nControl, 0.0);
+			std::vector<size_t> touched;
+			compose(blend, limit, 0, end - begin, acc, touched, chunks[worker]);
+		}, nThreads);
+
+		alglib::integer_1d_array rowSizes;
+		rowSizes.setlength(nPoints + nEdges);
+
+		size_t row = 0;
+		for (size_t w = 0; w < chunks.size(); w++)
+		{
+			size_t previous = 0;
+			for (size_t r = 0; r < chunks[w].rowStart.size(); r++)
+			{
+				rowSizes[row++] = chunks[w].rowStart[r] - previous;
+				previous = chunks[w].rowStart[r];
+			}
+		}
+		for (size_t e = 0; e < nEdges; e++)
+			rowSizes[nPoints + e] = 2;
+
+		alglib::sparsematrix a;
+		alglib::sparsecreatecrs(nPoints + nEdges, nControl, rowSizes, a);
+
+		row = 0;
+		for (size_t w = 0; w < chunks.size(); w++)
+		{
+			size_t k = 0;
+			for (size_t r = 0; r < chunks[w].rowStart.size(); r++, row++)
+				for (; k < chunks[w].rowStart[r]; k++)
+					alglib::sparseset(a, row, chunks[w].columns[k], chunks[w].weights[k]);
+		}
+
+		for (size_t e = 0; e < nEdges; e++)
+		{
+			alglib::sparseset(a, nPoints + e, edges[e * 2], spring);
+			alglib::sparseset(a, nPoints + e, edges[e * 2 + 1], -spring);
+		}
+
+		alglib::real_1d_array b, x;
+		b.setlength(nPoints + nEdges);
+
+		for (size_t d = 0; d < 3; d++)
+		{
+			// residuals at the current control points, solving for the displacement
+			for (size_t i = 0; i < nPoints; i++)
+			{
+				const size_t *face = &surface.refined.faces[projection.faces[i] * 3];
+
+				double q = 0;
+				for (size_t j = 0; j < 3; j++)
+					q += projection.barycentric[i * 3 + j] * surface.refined.vertices[face[j] * 3 + d];
+
+				b[i] = points[i][d] - q;
+			}
+
+			for (size_t e = 0; e < nEdges; e++)
+				b[nPoints + e] = -spring * (control.vertices[edges[e * 2] * 3 + d] - control.vertices[edges[e * 2 + 1] * 3 + d]);
+
+			solveSparseLeastSquares(a, b, x);
+
+			for (size_t v = 0; v < nControl; v++)
+				control.vertices[v * 3 + d] += x[v];
+		}
+
+		evaluateSubdivisionSurface(surface, nThreads);
+		projectPoints(surface.refined, points, nPoints, projection, nThreads);
+
+		if (log)
+			*log << "Iteration " << it << " energy E_dist + E_spring = " << distanceEnergy(projection) + springEnergy(control, edges, springConstant) << std::endl;
+	}
+
+	return distanceEnergy(projection) + springEnergy(control, edges, springConstant);
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <ostream>
+#include <vector>
+
+#include "Libraries/alglib/ap.h"
+
+#include "Mesh.h"
+
+
+/*
+	SparseRows
+
+		Row compressed sparse matrix with sorted
+		columns. Used for the linear operators that
+		map control vertices to refined or limit
+		vertices.
+*/
+
+struct SparseRows
+{
+	size_t nColumns;
+	std::vector<size_t> rowStart; // nRows + 1 entries
+	std::vector<size_t> columns;
+	std::vector<double> weights;
+
+	size_t nRows() const { return rowStart.empty() ? 0 : rowStart.size() - 1; }
+};
+
+
+/*
+	multiplySparse
+
+		Composes two operators, result = a * b.
+		Rows are computed in parallel.
+*/
+
+void multiplySparse(const SparseRows& a, const SparseRows& b, SparseRows& result, unsigned int nThreads = 0);
+
+
+/*
+	applySparse
+
+		Applies an operator to interleaved xyz
+		positions, in parallel over the rows.
+*/
+
+void applySparse(const SparseRows& op, const std::vector<double>& positions, std::vector<double>& result, unsigned int nThreads = 0);
+
+
+/*
+	loopSubdivide
+
+		One level of Loop subdivision. Old vertices
+		keep their indices, the vertex of edge e is
+		appended as nVertices + e (edges in the order
+		of meshEdges) and the four children of every
+		face are stored consecutively, so refined faces
+		stay next to the faces that touch the same
+		vertices.
+
+		Fills refined with the new connectivity and
+		the subdivided positions, and step with the
+		operator from the old to the new vertices.
+		Open boundaries and non-manifold edges use
+		the crease rules.
+*/
+
+void loopSubdivide(const TriangleMesh& mesh, TriangleMesh& refined, SparseRows& step);
+
+
+/*
+	loopLimitOperator
+
+		Operator that moves the vertices of a Loop
+		mesh to their positions on the limit surface.
+*/
+
+void loopLimitOperator(const TriangleMesh& mesh, SparseRows& limit);
+
+
+/*
+	SubdivisionSurface
+
+		Control mesh plus the connectivity of its
+		level N refinement and the operator that
+		takes control points straight to the limit
+		positions of the refined vertices.
+*/
+
+struct SubdivisionSurface
+{
+	TriangleMesh control;
+	unsigned int levels;
+	TriangleMesh refined;  // positions are limit positions
+	SparseRows limit;      // control vertices -> refined limit vertices
+};
+
+
+/*
+	buildSubdivisionSurface
+
+		Subdivides the control mesh levels times,
+		composes the per level operators with the
+		limit operator and evaluates the limit
+		positions.
+*/
+
+void buildSubdivisionSurface(SubdivisionSurface& surface, const TriangleMesh& control, unsigned int levels, unsigned int nThreads = 0);
+
+
+/*
+	evaluateSubdivisionSurface
+
+		Recomputes the limit positions after the
+		control points moved.
+*/
+
+void evaluateSubdivisionSurface(SubdivisionSurface& surface, unsigned int nThreads = 0);
+
+
+/*
+	fitSubdivisionSurface
+
+		Hoppe's third phase with fixed connectivity:
+		the limit surface is linear in the control
+		points, so with the points projected onto it
+		E_dist + E_spring is a sparse least squares
+		problem over the control points, solved with
+		the same machinery as the mesh optimization.
+		Alternates projections and solves, returns
+		E_dist + E_spring after the last iteration
+		and writes every iteration's to log if given.
+*/
+
+double fitSubdivisionSurface(
+	SubdivisionSurface& surface,
+	const alglib::real_2d_array& points,
+	size_t nPoints,
+	double springConstant,
+	unsigned int iterations,
+	unsigned int nThreads = 0,
+	std::ostream *log = NULL);
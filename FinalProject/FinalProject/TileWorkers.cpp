@@ -0,0 +1,473 @@
+#include "TileWorkers.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "Libraries/alglib/ap.h"
+
+#include "Parallel.h"
+
+
+#ifdef _WIN32
+
+bool orientTilesInProcesses(const TilingParameters& parameters, double radius, const std::vector<size_t>& tilePoints)
+{
+	std::cerr << "Tile worker processes are not supported on this platform, orienting in this process" << std::endl;
+
+	for (size_t t = 0; t < tilePoints.size(); t++)
+		if (tilePoints[t] > 0 && !orientTile(parameters, radius, t))
+			return false;
+	return true;
+}
+
+int runTileWorker(int, int, int)
+{
+	return 1;
+}
+
+#else
+
+namespace
+{
+	// coordinator to worker
+	struct WorkerTask
+	{
+		uint64_t tile;				// quitTask to stop
+		uint64_t nPoints;			// TilePoints at the start of the buffer
+		uint64_t bufferBytes;		// current size of the buffer
+		double radius;
+		uint32_t nThreads;
+		uint32_t reserved;
+	};
+
+	// worker to coordinator
+	struct WorkerResult
+	{
+		uint64_t tile;
+		uint64_t nOwn;				// TileNormals after the points
+		uint64_t nHalo;				// then HaloNormals
+		uint32_t ok;
+		uint32_t reserved;
+	};
+
+	const uint64_t quitTask = ~uint64_t(0);
+
+
+	// whole messages over the pipes, retried when interrupted
+	bool writeFully(int fd, const void *data, size_t bytes)
+	{
+		const char *p = static_cast<const char*>(data);
+		while (bytes > 0)
+		{
+			ssize_t n = ::write(fd, p, bytes);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return false;
+			p += n;
+			bytes -= size_t(n);
+		}
+		return true;
+	}
+
+	bool readFully(int fd, void *data, size_t bytes)
+	{
+		char *p = static_cast<char*>(data);
+		while (bytes > 0)
+		{
+			ssize_t n = ::read(fd, p, bytes);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return false;
+			p += n;
+			bytes -= size_t(n);
+		}
+		return true;
+	}
+
+
+	// the bytes a tile of nPoints needs: its points, then at most one normal per point
+	size_t tileBufferBytes(size_t nPoints)
+	{
+		return nPoints * (sizeof(TilePoint) + std::max(sizeof(TileNormal), sizeof(HaloNormal)));
+	}
+
+
+	// a shared buffer, mapped again whenever the other side resized it
+	struct SharedBuffer
+	{
+		int fd;
+		char *bytes;
+		size_t length;
+
+		SharedBuffer() : fd(-1), bytes(NULL), length(0) {}
+
+		bool map(size_t newLength)
+		{
+			if (bytes && newLength == length)
+				return true;
+			unmap();
+			void *p = mmap(NULL, newLength, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (p == MAP_FAILED)
+				return false;
+			bytes = static_cast<char*>(p);
+			length = newLength;
+			return true;
+		}
+
+		void unmap()
+		{
+			if (bytes)
+				munmap(bytes, length);
+			bytes = NULL;
+			length = 0;
+		}
+	};
+
+
+	struct Worker
+	{
+		pid_t pid;
+		int taskFd;					// our ends of the pipes
+		int resultFd;
+		SharedBuffer buffer;
+		size_t tile;				// being oriented, tilePoints.size() when idle
+	};
+
+	// an unnamed shared memory object: created, opened and unlinked at once
+	int createSharedMemory()
+	{
+		for (unsigned int attempt = 0; attempt < 16; attempt++)
+		{
+			char name[64];
+			std::snprintf(name, sizeof(name), "/finalproject-%ld-%u", long(getpid()), attempt);
+			int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+			if (fd >= 0)
+			{
+				shm_unlink(name);
+				return fd;
+			}
+			if (errno != EEXIST)
+				break;
+		}
+		return -1;
+	}
+
+	void setCloseOnExec(int fd, bool close)
+	{
+		int flags = fcntl(fd, F_GETFD);
+		fcntl(fd, F_SETFD, close ? (flags | FD_CLOEXEC) : (flags & ~FD_CLOEXEC));
+	}
+
+	// forks and execs a worker, the descriptors of the others aren't inherited
+	bool startWorker(const std::string& executable, Worker& worker)
+	{
+		int task[2], result[2];
+		if (pipe(task) != 0)
+			return false;
+		if (pipe(result) != 0)
+		{
+			close(task[0]);
+			close(task[1]);
+			return false;
+		}
+		worker.buffer.fd = createSharedMemory();
+		if (worker.buffer.fd < 0)
+		{
+			close(task[0]);
+			close(task[1]);
+			close(result[0]);
+			close(result[1]);
+			return false;
+		}
+
+		int fds[] = { task[0], task[1], result[0], result[1], worker.buffer.fd };
+		for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++)
+			setCloseOnExec(fds[i], true);
+
+		char arguments[3][24];
+		std::snprintf(arguments[0], sizeof(arguments[0]), "%d", task[0]);
+		std::snprintf(arguments[1], sizeof(arguments[1]), "%d", result[1]);
+		std::snprintf(arguments[2], sizeof(arguments[2]), "%d", worker.buffer.fd);
+
+		worker.pid = fork();
+		if (worker.pid == 0)
+		{
+			setCloseOnExec(task[0], false);
+			setCloseOnExec(result[1], false);
+			setCloseOnExec(worker.buffer.fd, false);
+
+			char *argv[] = { const_cast<char*>(executable.c_str()), const_cast<char*>("--tile-worker"),
+				arguments[0], arguments[1], arguments[2], NULL };
+			execv(executable.c_str(), argv);
+			_exit(127);
+		}
+
+		close(task[0]);
+		close(result[1]);
+		if (worker.pid < 0)
+		{
+			close(task[1]);
+			close(result[0]);
+			close(worker.buffer.fd);
+			worker.buffer.fd = -1;
+			return false;
+		}
+
+		worker.taskFd = task[1];
+		worker.resultFd = result[0];
+		return true;
+	}
+
+	void stopWorker(Worker& worker)
+	{
+		WorkerTask task = WorkerTask();
+		task.tile = quitTask;
+		writeFully(worker.taskFd, &task, sizeof(task));
+
+		close(worker.taskFd);
+		close(worker.resultFd);
+		worker.buffer.unmap();
+		close(worker.buffer.fd);
+
+		int status;
+		while (waitpid(worker.pid, &status, 0) < 0 && errno == EINTR) {}
+	}
+
+
+	// reads the points of tile into the buffer of worker, growing it, and sends the task
+	bool dispatchTile(const TilingParameters& parameters, double radius, unsigned int nThreads, size_t tile, size_t nPoints,
+		Worker& worker)
+	{
+		size_t bytes = std::max(tileBufferBytes(nPoints), worker.buffer.length);
+		if (bytes > worker.buffer.length && ftruncate(worker.buffer.fd, off_t(bytes)) != 0)
+			return false;
+		if (!worker.buffer.map(bytes))
+			return false;
+
+		FILE *file = std::fopen(tileFilename(parameters.workPrefix, tile, ".points").c_str(), "rb");
+		if (!file)
+			return false;
+		size_t read = std::fread(worker.buffer.bytes, sizeof(TilePoint), nPoints, file);
+		std::fclose(file);
+		if (read != nPoints)
+			return false;
+
+		WorkerTask task = WorkerTask();
+		task.tile = tile;
+		task.nPoints = nPoints;
+		task.bufferBytes = bytes;
+		task.radius = radius;
+		task.nThreads = nThreads;
+		if (!writeFully(worker.taskFd, &task, sizeof(task)))
+			return false;
+
+		worker.tile = tile;
+		return true;
+	}
+
+	// writes the normals a worker left in its buffer to the files of its tile
+	bool collectTile(const TilingParameters& parameters, const WorkerResult& result, size_t nPoints, const Worker& worker)
+	{
+		if (!result.ok || result.tile != worker.tile || result.nOwn + result.nHalo > nPoints)
+			return false;
+
+		const char *normals = worker.buffer.bytes + nPoints * sizeof(TilePoint);
+		const char *halo = normals + result.nOwn * sizeof(TileNormal);
+
+		bool ok = true;
+		const char *names[] = { ".normals", ".halo" };
+		const char *data[] = { normals, halo };
+		size_t sizes[] = { sizeof(TileNormal), sizeof(HaloNormal) };
+		uint64_t counts[] = { result.nOwn, result.nHalo };
+		for (size_t i = 0; ok && i < 2; i++)
+		{
+			FILE *file = std::fopen(tileFilename(parameters.workPrefix, worker.tile, names[i]).c_str(), "wb");
+			if (!file)
+				return false;
+			size_t written = counts[i] ? std::fwrite(data[i], sizes[i], size_t(counts[i]), file) : 0;
+			ok = std::fclose(file) == 0 && written == counts[i];
+		}
+		return ok;
+	}
+}
+
+
+bool orientTilesInProcesses(const TilingParameters& parameters, double radius, const std::vector<size_t>& tilePoints)
+{
+	size_t nTiles = tilePoints.size();
+
+	// largest first
+	std::vector<size_t> queue;
+	for (size_t t = 0; t < nTiles; t++)
+		if (tilePoints[t] > 0)
+			queue.push_back(t);
+	std::stable_sort(queue.begin(), queue.end(), [&](size_t a, size_t b) { return tilePoints[a] > tilePoints[b]; });
+
+	size_t nWorkers = std::min<size_t>(parameters.nProcesses, queue.size());
+	if (nWorkers == 0)
+		return true;
+
+	// the hardware threads are shared by the workers
+	unsigned int nThreads = parameters.nThreads;
+	if (nThreads == 0)
+		nThreads = std::max(1u, workerCount(0) / unsigned(nWorkers));
+
+	std::string executable = parameters.workerExecutable.empty() ? "/proc/self/exe" : parameters.workerExecutable;
+
+	// a dead worker fails the write of its next task instead of killing us
+	struct sigaction ignore, previous;
+	std::memset(&ignore, 0, sizeof(ignore));
+	ignore.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &ignore, &previous);
+
+	std::vector<Worker> workers;
+	bool ok = true;
+	for (size_t w = 0; w < nWorkers; w++)
+	{
+		Worker worker;
+		worker.tile = nTiles;
+		if (!startWorker(executable, worker))
+		{
+			std::cerr << "Could not start tile worker " << w << ": " << std::strerror(errno) << std::endl;
+			ok = false;
+			break;
+		}
+		workers.push_back(worker);
+	}
+
+	size_t next = 0, nBusy = 0;
+	for (size_t w = 0; ok && w < workers.size() && next < queue.size(); w++, next++)
+	{
+		ok = dispatchTile(parameters, radius, nThreads, queue[next], tilePoints[queue[next]], workers[w]);
+		nBusy += ok;
+	}
+
+	std::vector<pollfd> polled(workers.size());
+	while (ok && nBusy > 0)
+	{
+		for (size_t w = 0; w < workers.size(); w++)
+		{
+			polled[w].fd = workers[w].tile < nTiles ? workers[w].resultFd : -1;
+			polled[w].events = POLLIN;
+			polled[w].revents = 0;
+		}
+		if (poll(&polled[0], nfds_t(polled.size()), -1) < 0)
+		{
+			ok = errno == EINTR;
+			continue;
+		}
+
+		for (size_t w = 0; ok && w < workers.size(); w++)
+		{
+			if (!polled[w].revents)
+				continue;
+
+			Worker& worker = workers[w];
+			WorkerResult result;
+			if (!readFully(worker.resultFd, &result, sizeof(result)))
+			{
+				std::cerr << "Tile worker " << w << " died orienting tile " << worker.tile << std::endl;
+				ok = false;
+				break;
+			}
+			if (!collectTile(parameters, result, tilePoints[worker.tile], worker))
+			{
+				std::cerr << "Tile worker " << w << " failed on tile " << worker.tile << std::endl;
+				ok = false;
+				break;
+			}
+
+			worker.tile = nTiles;
+			nBusy--;
+			if (next < queue.size())
+			{
+				ok = dispatchTile(parameters, radius, nThreads, queue[next], tilePoints[queue[next]], worker);
+				next++;
+				nBusy += ok;
+			}
+		}
+	}
+
+	for (size_t w = 0; w < workers.size(); w++)
+		stopWorker(workers[w]);
+	sigaction(SIGPIPE, &previous, NULL);
+
+	return ok;
+}
+
+
+int runTileWorker(int taskFd, int resultFd, int sharedFd)
+{
+	SharedBuffer buffer;
+	buffer.fd = sharedFd;
+
+	std::vector<TileNormal> own;
+	std::vector<HaloNormal> halo;
+
+	WorkerTask task;
+	while (readFully(taskFd, &task, sizeof(task)) && task.tile != quitTask)
+	{
+		WorkerResult result = WorkerResult();
+		result.tile = task.tile;
+
+		if (buffer.map(size_t(task.bufferBytes)) && tileBufferBytes(size_t(task.nPoints)) <= buffer.length)
+		{
+			try
+			{
+				const TilePoint *points = reinterpret_cast<const TilePoint*>(buffer.bytes);
+				setAlglibWorkers(task.nThreads);	// this process' share of the threads
+				orientTilePoints(points, size_t(task.nPoints), size_t(task.tile), task.radius, task.nThreads, own, halo);
+
+				char *out = buffer.bytes + size_t(task.nPoints) * sizeof(TilePoint);
+				if (!own.empty())
+					std::memcpy(out, &own[0], own.size() * sizeof(TileNormal));
+				out += own.size() * sizeof(TileNormal);
+				if (!halo.empty())
+					std::memcpy(out, &halo[0], halo.size() * sizeof(HaloNormal));
+
+				result.nOwn = own.size();
+				result.nHalo = halo.size();
+				result.ok = 1;
+			}
+			catch (const alglib::ap_error& e)
+			{
+				std::cerr << "Tile " << task.tile << ": " << e.msg << std::endl;
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << "Tile " << task.tile << ": " << e.what() << std::endl;
+			}
+			catch (...)
+			{
+				std::cerr << "Tile " << task.tile << " failed" << std::endl;
+			}
+		}
+
+		if (!writeFully(resultFd, &result, sizeof(result)))
+			break;
+	}
+
+	buffer.unmap();
+	close(sharedFd);
+	close(taskFd);
+	close(resultFd);
+	return 0;
+}
+
+#endif
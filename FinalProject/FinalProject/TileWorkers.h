@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Tiling.h"
+
+
+/*
+	Tile worker processes
+
+		The orientation pass of the out-of-core mode
+		(see Tiling.h) spread over worker processes
+		of the same host, for when the threads of one
+		process are not enough.
+
+		The coordinator starts every worker as the
+		executable itself with --tile-worker and
+		three inherited descriptors: a task pipe, a
+		result pipe and a shared memory buffer. Each
+		task names a tile. The coordinator reads the
+		points of the tile from its file straight into
+		the buffer of the worker. The worker orients
+		them with orientTilePoints, writes its own
+		and halo normals back into the buffer after
+		the points, and answers with their counts.
+		The coordinator then writes them to the
+		.normals and .halo files the reconciliation
+		reads, and hands the worker the next tile.
+		Tiles go out largest first, so the slowest
+		tile isn't the last one scheduled.
+
+		POSIX only (fork/exec, pipes and shm_open);
+		elsewhere the tiles are oriented in the
+		calling process.
+*/
+
+
+/*
+	orientTilesInProcesses
+
+		orientTile for every tile with points, on
+		nProcesses workers. False if a worker could
+		not be started, failed or died.
+*/
+
+bool orientTilesInProcesses(const TilingParameters& parameters, double radius, const std::vector<size_t>& tilePoints);
+
+
+/*
+	runTileWorker
+
+		The loop of a worker process, until the
+		coordinator closes the task pipe or sends a
+		quit task. Returns the exit status.
+*/
+
+int runTileWorker(int taskFd, int resultFd, int sharedFd);
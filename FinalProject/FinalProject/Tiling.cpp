@@ -0,0 +1,715 @@
+#include "Tiling.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <utility>
+
+#include "Reconstructor.h"
+#include "TileWorkers.h"
+
+
+namespace
+{
+	// points per read of the input streams
+	const size_t streamBlock = 1 << 14;
+
+	// the derived tile size grows until the grid has at most this many tiles
+	const size_t maxGridTiles = size_t(1) << 22;
+
+
+	template <typename T>
+	bool readRecords(const std::string& filename, std::vector<T>& records, size_t count)
+	{
+		records.resize(count);
+		if (count == 0)
+			return true;
+
+		FILE *file = std::fopen(filename.c_str(), "rb");
+		if (!file)
+			return false;
+
+		size_t read = std::fread(&records[0], sizeof(T), count, file);
+		std::fclose(file);
+		return read == count;
+	}
+
+	// every record of a file, its size giving their number
+	template <typename T>
+	bool readAllRecords(const std::string& filename, std::vector<T>& records)
+	{
+		FILE *file = std::fopen(filename.c_str(), "rb");
+		if (!file)
+			return false;
+
+		std::fseek(file, 0, SEEK_END);
+		long bytes = std::ftell(file);
+		std::fclose(file);
+
+		return bytes >= 0 && readRecords(filename, records, size_t(bytes) / sizeof(T));
+	}
+
+	template <typename T>
+	bool writeRecords(const std::string& filename, const std::vector<T>& records, bool append)
+	{
+		FILE *file = std::fopen(filename.c_str(), append ? "ab" : "wb");
+		if (!file)
+			return false;
+
+		size_t written = records.empty() ? 0 : std::fwrite(&records[0], sizeof(T), records.size(), file);
+		bool closed = std::fclose(file) == 0;
+		return closed && written == records.size();
+	}
+
+
+	struct Bounds
+	{
+		double lower[3];
+		double upper[3];
+		size_t nPoints;
+	};
+
+	bool scanBounds(const std::string& input, CloudFormat format, Bounds& bounds)
+	{
+		PointStream stream;
+		if (!stream.open(input, format))
+			return false;
+
+		for (size_t d = 0; d < constants::dims; d++)
+		{
+			bounds.lower[d] = HUGE_VAL;
+			bounds.upper[d] = -HUGE_VAL;
+		}
+		bounds.nPoints = 0;
+
+		std::vector<double> block(streamBlock * constants::dims);
+		while (size_t count = stream.read(&block[0], streamBlock))
+		{
+			for (size_t i = 0; i < count; i++)
+				for (size_t d = 0; d < constants::dims; d++)
+				{
+					bounds.lower[d] = std::min(bounds.lower[d], block[i * constants::dims + d]);
+					bounds.upper[d] = std::max(bounds.upper[d], block[i * constants::dims + d]);
+				}
+			bounds.nPoints += count;
+		}
+
+		return !stream.failed();
+	}
+
+	void layGrid(const Bounds& bounds, double size, TileGrid& grid)
+	{
+		size_t nTiles;
+		do
+		{
+			nTiles = 1;
+			for (size_t d = 0; d < constants::dims; d++)
+			{
+				grid.origin[d] = bounds.lower[d];
+				grid.dims[d] = std::max<size_t>(1, size_t(std::ceil((bounds.upper[d] - bounds.lower[d]) / size)));
+				nTiles *= grid.dims[d];
+			}
+			grid.size = size;
+			size *= 1.25;
+		} while (nTiles > maxGridTiles);
+	}
+
+	// the points of one tile, without halo, for the radius estimation
+	bool collectTile(const std::string& input, CloudFormat format, const TileGrid& grid, size_t tile, std::vector<double>& points)
+	{
+		PointStream stream;
+		if (!stream.open(input, format))
+			return false;
+
+		points.clear();
+		std::vector<double> block(streamBlock * constants::dims);
+		while (size_t count = stream.read(&block[0], streamBlock))
+			for (size_t i = 0; i < count; i++)
+				if (grid.tileOf(&block[i * constants::dims]) == tile)
+					points.insert(points.end(), &block[i * constants::dims], &block[i * constants::dims] + constants::dims);
+
+		return !stream.failed();
+	}
+
+
+	// union-find root, for the pieces of a tile and the groups of the spanning forest
+	size_t findRoot(std::vector<size_t>& parent, size_t t)
+	{
+		while (parent[t] != t)
+		{
+			parent[t] = parent[parent[t]];
+			t = parent[t];
+		}
+		return t;
+	}
+}
+
+
+size_t TileGrid::tileOf(const double *p) const
+{
+	size_t tile = 0;
+	for (size_t d = constants::dims; d-- > 0; )
+	{
+		double c = std::floor((p[d] - origin[d]) / size);
+		size_t cell = c <= 0 ? 0 : std::min(dims[d] - 1, size_t(c));
+		tile = tile * dims[d] + cell;
+	}
+	return tile;
+}
+
+void TileGrid::neighbors(size_t tile, std::vector<size_t>& result) const
+{
+	size_t c[3] = { tile % dims[0], tile / dims[0] % dims[1], tile / (dims[0] * dims[1]) };
+
+	result.clear();
+	for (int dz = -1; dz <= 1; dz++)
+		for (int dy = -1; dy <= 1; dy++)
+			for (int dx = -1; dx <= 1; dx++)
+			{
+				if (dx == 0 && dy == 0 && dz == 0)
+					continue;
+
+				long long n[3] = { (long long)c[0] + dx, (long long)c[1] + dy, (long long)c[2] + dz };
+				if (n[0] < 0 || n[1] < 0 || n[2] < 0 || n[0] >= (long long)dims[0] || n[1] >= (long long)dims[1] || n[2] >= (long long)dims[2])
+					continue;
+
+				result.push_back(size_t(n[0]) + dims[0] * (size_t(n[1]) + dims[1] * size_t(n[2])));
+			}
+}
+
+double TileGrid::distance(const double *p, size_t tile) const
+{
+	size_t c[3] = { tile % dims[0], tile / dims[0] % dims[1], tile / (dims[0] * dims[1]) };
+
+	double squared = 0;
+	for (size_t d = 0; d < constants::dims; d++)
+	{
+		double lower = origin[d] + c[d] * size;
+		double upper = lower + size;
+		double outside = p[d] < lower ? lower - p[d] : (p[d] > upper ? p[d] - upper : 0);
+		squared += outside * outside;
+	}
+	return std::sqrt(squared);
+}
+
+
+std::string tileFilename(const std::string& workPrefix, size_t tile, const std::string& extension)
+{
+	char number[32];
+	std::snprintf(number, sizeof(number), "_%06zu", tile);
+	return workPrefix + number + extension;
+}
+
+
+bool planTiles(const std::string& input, CloudFormat format, const TilingParameters& parameters, TileGrid& grid, TilingReport& report)
+{
+	Bounds bounds;
+	if (!scanBounds(input, format, bounds))
+		return false;
+
+	report.nPoints = bounds.nPoints;
+	if (bounds.nPoints == 0)
+	{
+		std::cerr << input << ": no points" << std::endl;
+		return false;
+	}
+
+	// scans are surfaces: a tile holds about nPoints * size^2 / area points, the area
+	// taken as the largest face of the bounds
+	double size = parameters.tileSize;
+	if (size <= 0)
+	{
+		double extent[3], area = 0;
+		for (size_t d = 0; d < constants::dims; d++)
+			extent[d] = bounds.upper[d] - bounds.lower[d];
+		for (size_t d = 0; d < constants::dims; d++)
+			area = std::max(area, extent[d] * extent[(d + 1) % constants::dims]);
+
+		size = std::sqrt(area * double(parameters.maxTilePoints) / double(bounds.nPoints));
+		if (size <= 0)
+			size = std::max(extent[0], std::max(extent[1], std::max(extent[2], 1.0)));
+	}
+
+	layGrid(bounds, size, grid);
+
+	double radius = parameters.radius;
+	if (radius <= 0)
+	{
+		// the densest tile, where the estimate has the most neighbors to go by
+		std::vector<size_t> counts(grid.nTiles(), 0);
+		PointStream stream;
+		if (!stream.open(input, format))
+			return false;
+
+		std::vector<double> block(streamBlock * constants::dims);
+		while (size_t count = stream.read(&block[0], streamBlock))
+			for (size_t i = 0; i < count; i++)
+				counts[grid.tileOf(&block[i * constants::dims])]++;
+
+		size_t densest = size_t(std::max_element(counts.begin(), counts.end()) - counts.begin());
+
+		std::vector<double> coordinates;
+		if (stream.failed() || !collectTile(input, format, grid, densest, coordinates))
+			return false;
+
+		size_t n = coordinates.size() / constants::dims;
+		alglib::real_2d_array points;
+		points.setcontent(n, constants::dims, &coordinates[0]);
+
+		alglib::kdtree kdt;
+		buildKDTree(kdt, points, n, parameters.nThreads);
+		radius = estimateRadius(kdt, points, n, parameters.radiusNeighbors);
+	}
+
+	// the halo only reaches the adjacent tiles
+	if (grid.size < radius)
+		layGrid(bounds, radius, grid);
+
+	report.radius = radius;
+	report.tileSize = grid.size;
+	return true;
+}
+
+
+bool partitionTiles(const std::string& input, CloudFormat format, const TilingParameters& parameters, const TileGrid& grid,
+	double radius, std::vector<size_t>& tilePoints, TilingReport& report)
+{
+	PointStream stream;
+	if (!stream.open(input, format))
+		return false;
+
+	tilePoints.assign(grid.nTiles(), 0);
+
+	// points wait in per tile buffers, all flushed together when bufferPoints are held
+	std::map<size_t, std::vector<TilePoint> > buffers;
+	size_t buffered = 0;
+
+	std::vector<size_t> around;
+	std::vector<double> block(streamBlock * constants::dims);
+	uint64_t index = 0;
+	report.nHaloPoints = 0;
+
+	bool ok = true;
+	while (size_t count = stream.read(&block[0], streamBlock))
+	{
+		for (size_t i = 0; i < count; i++, index++)
+		{
+			TilePoint point;
+			std::copy(&block[i * constants::dims], &block[i * constants::dims] + constants::dims, point.xyz);
+			point.index = index;
+			point.owner = uint32_t(grid.tileOf(point.xyz));
+			point.reserved = 0;
+
+			buffers[point.owner].push_back(point);
+			buffered++;
+
+			grid.neighbors(point.owner, around);
+			for (size_t n = 0; n < around.size(); n++)
+				if (grid.distance(point.xyz, around[n]) <= radius)
+				{
+					buffers[around[n]].push_back(point);
+					buffered++;
+					report.nHaloPoints++;
+				}
+		}
+
+		if (buffered >= parameters.bufferPoints)
+		{
+			for (std::map<size_t, std::vector<TilePoint> >::iterator b = buffers.begin(); b != buffers.end(); ++b)
+			{
+				ok = ok && writeRecords(tileFilename(parameters.workPrefix, b->first, ".points"), b->second, tilePoints[b->first] > 0);
+				tilePoints[b->first] += b->second.size();
+			}
+			buffers.clear();
+			buffered = 0;
+		}
+	}
+
+	for (std::map<size_t, std::vector<TilePoint> >::iterator b = buffers.begin(); b != buffers.end(); ++b)
+	{
+		ok = ok && writeRecords(tileFilename(parameters.workPrefix, b->first, ".points"), b->second, tilePoints[b->first] > 0);
+		tilePoints[b->first] += b->second.size();
+	}
+
+	report.nTiles = 0;
+	report.largestTile = 0;
+	for (size_t t = 0; t < tilePoints.size(); t++)
+		if (tilePoints[t] > 0)
+		{
+			report.nTiles++;
+			report.largestTile = std::max(report.largestTile, tilePoints[t]);
+		}
+
+	if (!ok)
+		std::cerr << "Cannot write the tiles to " << parameters.workPrefix << "_*.points" << std::endl;
+
+	return ok && !stream.failed();
+}
+
+
+void orientTilePoints(const TilePoint *points, size_t nPoints, size_t tile, double radius, unsigned int nThreads,
+	std::vector<TileNormal>& own, std::vector<HaloNormal>& halo)
+{
+	own.clear();
+	halo.clear();
+	if (nPoints == 0)
+		return;
+
+	alglib::real_2d_array xyz;
+	xyz.setlength(nPoints, constants::dims);
+	for (size_t i = 0; i < nPoints; i++)
+		for (size_t d = 0; d < constants::dims; d++)
+			xyz[i][d] = points[i].xyz[d];
+
+	ReconstructionParameters parameters;
+	parameters.radius = radius;
+	parameters.nThreads = nThreads;
+
+	Reconstructor reconstructor(parameters);
+	reconstructor.setPoints(xyz, nPoints);
+	reconstructor.orientNormals();
+
+	// the pieces of the tile: the MST links them through edges missing from the graph
+	const std::vector<size_t>& mst = reconstructor.mst();
+	const RiemannianGraph& graph = reconstructor.graph();
+
+	std::vector<size_t> piece(nPoints);
+	for (size_t i = 0; i < nPoints; i++)
+		piece[i] = i;
+	for (size_t i = 0; i < nPoints; i++)
+		if (mst[i] < nPoints && graph.weight(i, mst[i]) != DBL_MAX)
+			piece[findRoot(piece, i)] = findRoot(piece, mst[i]);
+
+	std::vector<uint32_t> component(nPoints);
+	std::map<size_t, uint32_t> components;
+	for (size_t i = 0; i < nPoints; i++)
+	{
+		size_t root = findRoot(piece, i);
+		std::map<size_t, uint32_t>::iterator found = components.find(root);
+		if (found == components.end())
+			found = components.insert(std::make_pair(root, uint32_t(components.size()))).first;
+		component[i] = found->second;
+	}
+
+	const Vec3Arrays& normals = reconstructor.normals();
+	for (size_t i = 0; i < nPoints; i++)
+	{
+		if (points[i].owner == tile)
+		{
+			TileNormal normal;
+			std::copy(points[i].xyz, points[i].xyz + constants::dims, normal.xyz);
+			for (size_t d = 0; d < constants::dims; d++)
+				normal.normal[d] = normals(i, d);
+			normal.index = points[i].index;
+			normal.component = component[i];
+			normal.reserved = 0;
+			own.push_back(normal);
+		}
+		else
+		{
+			HaloNormal normal;
+			normal.index = points[i].index;
+			normal.owner = points[i].owner;
+			normal.component = component[i];
+			for (size_t d = 0; d < constants::dims; d++)
+				normal.normal[d] = normals(i, d);
+			halo.push_back(normal);
+		}
+	}
+}
+
+
+bool orientTile(const TilingParameters& parameters, double radius, size_t tile)
+{
+	std::vector<TilePoint> points;
+	if (!readAllRecords(tileFilename(parameters.workPrefix, tile, ".points"), points))
+		return false;
+
+	std::vector<TileNormal> own;
+	std::vector<HaloNormal> halo;
+	orientTilePoints(points.empty() ? NULL : &points[0], points.size(), tile, radius, parameters.nThreads, own, halo);
+
+	return writeRecords(tileFilename(parameters.workPrefix, tile, ".normals"), own, false)
+		&& writeRecords(tileFilename(parameters.workPrefix, tile, ".halo"), halo, false);
+}
+
+
+bool reconcileTiles(const TilingParameters& parameters, const TileGrid& grid, const std::vector<size_t>& tilePoints,
+	TileSigns& signs, TilingReport& report)
+{
+	size_t nTiles = tilePoints.size();
+
+	// the components are the vertices of the reconciliation, numbered tile by tile
+	std::vector<size_t> firstVertex(nTiles + 1, 0);
+
+	std::vector<TileNormal> own;
+	std::vector<HaloNormal> halo;
+	std::vector<size_t> around;
+
+	for (size_t t = 0; t < nTiles; t++)
+	{
+		size_t nComponents = 0;
+		if (tilePoints[t] > 0)
+		{
+			if (!readAllRecords(tileFilename(parameters.workPrefix, t, ".normals"), own)
+				|| !readAllRecords(tileFilename(parameters.workPrefix, t, ".halo"), halo))
+				return false;
+
+			for (size_t i = 0; i < own.size(); i++)
+				nComponents = std::max<size_t>(nComponents, own[i].component + 1);
+			for (size_t h = 0; h < halo.size(); h++)
+				nComponents = std::max<size_t>(nComponents, halo[h].component + 1);
+		}
+		firstVertex[t + 1] = firstVertex[t] + nComponents;
+	}
+
+	size_t nVertices = firstVertex[nTiles];
+	report.nComponents = nVertices;
+
+	// sum of n_a . n_b over the points a component and the halo of a neighbor share
+	std::map<std::pair<size_t, size_t>, double> votes;
+
+	// the topmost point of every component and the z of its normal, to align the groups by Hoppe's rule
+	std::vector<double> top(nVertices, -DBL_MAX), topNormal(nVertices, 0);
+
+	for (size_t a = 0; a < nTiles; a++)
+	{
+		if (tilePoints[a] == 0)
+			continue;
+
+		// in input order, the partition appends them as they are read
+		if (!readAllRecords(tileFilename(parameters.workPrefix, a, ".normals"), own))
+			return false;
+
+		for (size_t i = 0; i < own.size(); i++)
+		{
+			size_t c = firstVertex[a] + own[i].component;
+			if (own[i].xyz[2] > top[c])
+			{
+				top[c] = own[i].xyz[2];
+				topNormal[c] = own[i].normal[2];
+			}
+		}
+
+		grid.neighbors(a, around);
+		for (size_t n = 0; n < around.size(); n++)
+		{
+			size_t b = around[n];
+			if (tilePoints[b] == 0 || !readAllRecords(tileFilename(parameters.workPrefix, b, ".halo"), halo))
+				continue;
+
+			for (size_t h = 0; h < halo.size(); h++)
+			{
+				if (halo[h].owner != a)
+					continue;
+
+				TileNormal key;
+				key.index = halo[h].index;
+				std::vector<TileNormal>::const_iterator match = std::lower_bound(own.begin(), own.end(), key,
+					[](const TileNormal& x, const TileNormal& y) { return x.index < y.index; });
+				if (match == own.end() || match->index != halo[h].index)
+					continue;
+
+				double vote = 0;
+				for (size_t d = 0; d < constants::dims; d++)
+					vote += match->normal[d] * halo[h].normal[d];
+
+				size_t u = firstVertex[a] + match->component, v = firstVertex[b] + halo[h].component;
+				votes[std::make_pair(std::min(u, v), std::max(u, v))] += vote;
+			}
+		}
+	}
+
+	// maximum spanning forest of the vote strengths (Kruskal)
+	std::vector<std::pair<double, std::pair<size_t, size_t> > > edges;
+	for (std::map<std::pair<size_t, size_t>, double>::const_iterator v = votes.begin(); v != votes.end(); ++v)
+		if (v->second != 0)
+			edges.push_back(std::make_pair(std::fabs(v->second), v->first));
+	std::sort(edges.rbegin(), edges.rend());
+
+	// then the signs a tile gave its pieces across the gaps of its MST, like the in-core tree does, only
+	// joining the pieces no vote joins; a tile never votes on itself, so these pairs have no vote
+	for (size_t t = 0; t < nTiles; t++)
+		for (size_t c = firstVertex[t] + 1; c < firstVertex[t + 1]; c++)
+			edges.push_back(std::make_pair(0.0, std::make_pair(firstVertex[t], c)));
+
+	std::vector<size_t> parent(nVertices);
+	for (size_t c = 0; c < nVertices; c++)
+		parent[c] = c;
+
+	std::vector<std::vector<std::pair<size_t, int> > > forest(nVertices);
+	for (size_t e = 0; e < edges.size(); e++)
+	{
+		size_t u = edges[e].second.first, v = edges[e].second.second;
+		size_t ru = findRoot(parent, u), rv = findRoot(parent, v);
+		if (ru == rv)
+			continue;
+
+		parent[ru] = rv;
+		std::map<std::pair<size_t, size_t>, double>::const_iterator vote = votes.find(edges[e].second);
+		int agreement = vote == votes.end() || vote->second > 0 ? 1 : -1;
+		forest[u].push_back(std::make_pair(v, agreement));
+		forest[v].push_back(std::make_pair(u, agreement));
+	}
+
+	// relative signs along the forest, then every group turned so that the normal of its topmost point has +z
+	std::vector<int> sign(nVertices, 0);
+	report.nGroups = 0;
+	report.nFlipped = 0;
+
+	std::vector<size_t> group;
+	for (size_t root = 0; root < nVertices; root++)
+	{
+		if (sign[root] != 0)
+			continue;
+
+		report.nGroups++;
+		group.clear();
+		group.push_back(root);
+		sign[root] = 1;
+
+		for (size_t g = 0; g < group.size(); g++)
+		{
+			size_t c = group[g];
+			for (size_t n = 0; n < forest[c].size(); n++)
+				if (sign[forest[c][n].first] == 0)
+				{
+					sign[forest[c][n].first] = sign[c] * forest[c][n].second;
+					group.push_back(forest[c][n].first);
+				}
+		}
+
+		size_t topmost = root;
+		for (size_t g = 0; g < group.size(); g++)
+			if (top[group[g]] > top[topmost])
+				topmost = group[g];
+
+		int flip = sign[topmost] * topNormal[topmost] < 0 ? -1 : 1;
+		for (size_t g = 0; g < group.size(); g++)
+		{
+			sign[group[g]] *= flip;
+			if (sign[group[g]] < 0)
+				report.nFlipped++;
+		}
+	}
+
+	signs.assign(nTiles, std::vector<int>());
+	for (size_t t = 0; t < nTiles; t++)
+		signs[t].assign(sign.begin() + firstVertex[t], sign.begin() + firstVertex[t + 1]);
+
+	return true;
+}
+
+
+bool writeOrientedTiles(const TilingParameters& parameters, const std::vector<size_t>& tilePoints, const TileSigns& signs,
+	size_t nPoints, const std::string& output, CloudFormat outputFormat)
+{
+	OrientedCloudWriter writer;
+	if (!writer.open(output, nPoints, outputFormat, parameters.nThreads))
+		return false;
+
+	std::vector<TileNormal> own;
+	std::vector<double> xyz, normals;
+
+	for (size_t t = 0; t < tilePoints.size(); t++)
+	{
+		if (tilePoints[t] == 0)
+			continue;
+
+		if (!readAllRecords(tileFilename(parameters.workPrefix, t, ".normals"), own))
+			return false;
+
+		xyz.resize(own.size() * constants::dims);
+		normals.resize(own.size() * constants::dims);
+		for (size_t i = 0; i < own.size(); i++)
+			for (size_t d = 0; d < constants::dims; d++)
+			{
+				xyz[i * constants::dims + d] = own[i].xyz[d];
+				normals[i * constants::dims + d] = signs[t][own[i].component] * own[i].normal[d];
+			}
+
+		if (!own.empty() && !writer.write(&xyz[0], &normals[0], own.size()))
+			return false;
+	}
+
+	return writer.close();
+}
+
+
+void removeTileFiles(const TilingParameters& parameters, const std::vector<size_t>& tilePoints)
+{
+	const char *extensions[] = { ".points", ".normals", ".halo" };
+	for (size_t t = 0; t < tilePoints.size(); t++)
+		if (tilePoints[t] > 0)
+			for (size_t e = 0; e < 3; e++)
+				std::remove(tileFilename(parameters.workPrefix, t, extensions[e]).c_str());
+}
+
+
+bool orientOutOfCore(const std::string& input, CloudFormat format, const std::string& output, CloudFormat outputFormat,
+	const TilingParameters& parameters, TilingReport& report, StageProfiler *profiler)
+{
+	if (profiler)
+		profiler->begin("tile plan");
+
+	TileGrid grid;
+	if (!planTiles(input, format, parameters, grid, report))
+	{
+		if (profiler)
+			profiler->end();
+		return false;
+	}
+
+	if (profiler)
+	{
+		profiler->count("points", report.nPoints);
+		profiler->begin("tile partition");
+	}
+
+	std::vector<size_t> tilePoints;
+	bool ok = partitionTiles(input, format, parameters, grid, report.radius, tilePoints, report);
+
+	if (profiler)
+	{
+		profiler->count("tiles", report.nTiles);
+		profiler->count("halo", report.nHaloPoints);
+		profiler->begin("tile orientation");
+	}
+
+	if (ok && parameters.nProcesses > 1)
+		ok = orientTilesInProcesses(parameters, report.radius, tilePoints);
+	else
+		for (size_t t = 0; ok && t < tilePoints.size(); t++)
+			if (tilePoints[t] > 0)
+				ok = orientTile(parameters, report.radius, t);
+
+	if (profiler)
+		profiler->begin("tile reconcile");
+
+	TileSigns signs;
+	ok = ok && reconcileTiles(parameters, grid, tilePoints, signs, report);
+
+	if (profiler)
+	{
+		profiler->count("components", report.nComponents);
+		profiler->count("groups", report.nGroups);
+		profiler->count("flipped", report.nFlipped);
+		profiler->begin("tile output");
+	}
+
+	ok = ok && writeOrientedTiles(parameters, tilePoints, signs, report.nPoints, output, outputFormat);
+
+	if (profiler)
+	{
+		profiler->count("points", report.nPoints);
+		profiler->end();
+	}
+
+	if (!parameters.keepTiles)
+		removeTileFiles(parameters, tilePoints);
+
+	return ok;
+}
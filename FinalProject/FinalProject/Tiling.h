@@ -0,0 +1,235 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Instrumentation.h"
+#include "PointCloud.h"
+
+
+/*
+	Out-of-core orientation
+
+		Estimates and orients the normals of a cloud
+		that doesn't fit in memory, holding one tile
+		at a time:
+
+		1. plan: stream the cloud for its bounds and
+		   lay a grid of cubic tiles over it
+		2. partition: stream it again, appending
+		   every point to the file of its tile, and a
+		   copy to the neighboring tiles closer than
+		   the radius (their halo)
+		3. orient: every tile goes through plane
+		   estimation, graph, MST and propagation on
+		   its own, the halo completing the
+		   neighborhoods of the points on its border.
+		   A tile can cut the surface in several
+		   pieces, not connected in its graph, so
+		   the normals are only consistent within
+		   each piece (component) of the tile
+		4. reconcile: the normals of the points both
+		   a tile and a neighbor's halo have vote on
+		   the relative sign of their components; the
+		   signs are propagated along the maximum
+		   spanning forest of the votes, then across
+		   the gaps each tile's own MST bridged, and every
+		   connected group of components is turned so
+		   that its topmost point has a +z normal
+		   (Hoppe's rule). The tiles keep the
+		   estimated normal of their MST root
+		5. write: the tiles are streamed to the
+		   output with their signs applied, tile by
+		   tile, so the points are not in the input
+		   order
+
+		Intermediate files are <workPrefix>_<tile>.*
+		and removed at the end unless asked to keep
+		them.
+*/
+
+struct TilingParameters
+{
+	double radius;					// neighborhood radius and halo width, 0 to estimate it
+	size_t radiusNeighbors;			// neighbors per radius query when estimating it
+	double tileSize;				// edge of the tiles, 0 to derive it from maxTilePoints
+	size_t maxTilePoints;			// points per tile when deriving the tile size
+	size_t bufferPoints;			// points held in memory while partitioning
+	std::string workPrefix;			// intermediate files
+	bool keepTiles;
+	unsigned int nThreads;			// worker threads of every tile
+	unsigned int nProcesses;		// orient the tiles on worker processes, see TileWorkers.h, 0 or 1 for none
+	std::string workerExecutable;	// started with --tile-worker, empty for the running one
+
+	TilingParameters()
+		: radius(0), radiusNeighbors(24), tileSize(0), maxTilePoints(2000), bufferPoints(1 << 20),
+		keepTiles(false), nThreads(0), nProcesses(0) {}
+};
+
+
+/*
+	TileGrid
+
+		Cubic tiles of edge size from origin, points
+		outside the grid go to the nearest tile.
+*/
+
+struct TileGrid
+{
+	double origin[3];
+	double size;
+	size_t dims[3];
+
+	TileGrid() : size(0)
+	{
+		origin[0] = origin[1] = origin[2] = 0;
+		dims[0] = dims[1] = dims[2] = 0;
+	}
+
+	size_t nTiles() const { return dims[0] * dims[1] * dims[2]; }
+	size_t tileOf(const double *p) const;
+
+	// the tiles around tile, itself excluded
+	void neighbors(size_t tile, std::vector<size_t>& result) const;
+
+	// distance from p to the box of tile, 0 inside
+	double distance(const double *p, size_t tile) const;
+};
+
+
+// a point in the file of a tile, owned by it or in its halo
+struct TilePoint
+{
+	double xyz[3];
+	uint64_t index;					// in the input
+	uint32_t owner;					// the tile the point belongs to
+	uint32_t reserved;
+};
+
+// a point of a tile with its locally oriented normal
+struct TileNormal
+{
+	double xyz[3];
+	double normal[3];
+	uint64_t index;
+	uint32_t component;				// connected piece of the tile
+	uint32_t reserved;
+};
+
+// the normal a tile gave to a point of its halo, a vote for the sign of owner
+struct HaloNormal
+{
+	uint64_t index;
+	uint32_t owner;
+	uint32_t component;				// of the point in the voting tile
+	double normal[3];
+};
+
+// sign of every component of every tile, +1 or -1
+typedef std::vector<std::vector<int> > TileSigns;
+
+
+struct TilingReport
+{
+	size_t nPoints;
+	size_t nTiles;					// tiles with points
+	size_t largestTile;				// points, halo included
+	size_t nHaloPoints;
+	size_t nComponents;				// connected pieces of the tiles
+	size_t nGroups;					// connected groups of components
+	size_t nFlipped;				// components whose normals were flipped
+	double radius;
+	double tileSize;
+
+	TilingReport()
+		: nPoints(0), nTiles(0), largestTile(0), nHaloPoints(0), nComponents(0), nGroups(0), nFlipped(0), radius(0), tileSize(0) {}
+};
+
+
+// <workPrefix>_<tile><extension>
+std::string tileFilename(const std::string& workPrefix, size_t tile, const std::string& extension);
+
+
+/*
+	planTiles
+
+		Bounds and number of points of the cloud and
+		the grid over them, and the radius when it
+		must be estimated: on the most populated
+		tile, with a third pass to collect it.
+*/
+
+bool planTiles(const std::string& input, CloudFormat format, const TilingParameters& parameters, TileGrid& grid, TilingReport& report);
+
+
+/*
+	partitionTiles
+
+		Writes <workPrefix>_<tile>.points for every
+		tile with points, and their number, halo
+		included, in tilePoints.
+*/
+
+bool partitionTiles(const std::string& input, CloudFormat format, const TilingParameters& parameters, const TileGrid& grid,
+	double radius, std::vector<size_t>& tilePoints, TilingReport& report);
+
+
+/*
+	orientTilePoints
+
+		Normals of the points of a tile, oriented
+		consistently within each of its components,
+		split into its own points and its halo.
+*/
+
+void orientTilePoints(const TilePoint *points, size_t nPoints, size_t tile, double radius, unsigned int nThreads,
+	std::vector<TileNormal>& own, std::vector<HaloNormal>& halo);
+
+
+/*
+	orientTile
+
+		orientTilePoints from <workPrefix>_<tile>.points
+		to <workPrefix>_<tile>.normals and .halo
+*/
+
+bool orientTile(const TilingParameters& parameters, double radius, size_t tile);
+
+
+/*
+	reconcileTiles
+
+		Sign of every component of every tile from
+		the halo votes of the oriented tiles.
+*/
+
+bool reconcileTiles(const TilingParameters& parameters, const TileGrid& grid, const std::vector<size_t>& tilePoints,
+	TileSigns& signs, TilingReport& report);
+
+
+/*
+	writeOrientedTiles
+
+		Streams the normals of the tiles, signs
+		applied, to an oriented cloud (see
+		OrientedCloudWriter).
+*/
+
+bool writeOrientedTiles(const TilingParameters& parameters, const std::vector<size_t>& tilePoints, const TileSigns& signs,
+	size_t nPoints, const std::string& output, CloudFormat outputFormat);
+
+
+// removes the intermediate files of the tiles
+void removeTileFiles(const TilingParameters& parameters, const std::vector<size_t>& tilePoints);
+
+
+/*
+	orientOutOfCore
+
+		Every pass above, in order, each recorded
+		as a stage when a profiler is given.
+*/
+
+bool orientOutOfCore(const std::string& input, CloudFormat format, const std::string& output, CloudFormat outputFormat,
+	const TilingParameters& parameters, TilingReport& report, StageProfiler *profiler = NULL);